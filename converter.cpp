@@ -0,0 +1,152 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QtDebug>
+#  include <QTextStream>
+#include "warnpop.h"
+#include <algorithm>
+#include <map>
+
+#include "converter.h"
+
+namespace {
+
+// build the entries for mapping from one script to the other. the
+// words with the same text in the source script are ordered by their
+// frequency. the single characters are mapped by how often each pair
+// occurs in all the words, weighed by the frequencies of the longer
+// words, so that a rare counterpart doesn't win. the characters that
+// are words by themselves all have the same character frequency so
+// they only count once.
+template<typename From, typename To>
+std::vector<pime::trie::entry> make_entries(const std::vector<const pime::dictionary::word*>& words,
+    From from, To to)
+{
+    std::vector<pime::trie::entry> ret;
+
+    std::map<std::pair<QChar, QChar>, quint64> pairs;
+    for (const auto* word : words)
+    {
+        const auto& src = from(*word);
+        const auto& dst = to(*word);
+        if (src.size() != dst.size())
+            continue;
+        if (src.size() > 1)
+            ret.push_back(pime::trie::entry{src, dst});
+        const quint64 weight = src.size() > 1 ? 1 + word->frequency : 1;
+        for (int i=0; i<src.size(); ++i)
+            pairs[std::make_pair(src[i], dst[i])] += weight;
+    }
+
+    std::vector<std::pair<quint64, pime::trie::entry>> chars;
+    for (const auto& pair : pairs)
+    {
+        const pime::trie::entry e { QString(pair.first.first), QString(pair.first.second) };
+        chars.push_back(std::make_pair(pair.second, e));
+    }
+    std::stable_sort(std::begin(chars), std::end(chars),
+        [](const std::pair<quint64, pime::trie::entry>& lhs,
+           const std::pair<quint64, pime::trie::entry>& rhs) {
+            return lhs.first > rhs.first;
+        });
+    for (const auto& c : chars)
+        ret.push_back(c.second);
+
+    return ret;
+}
+
+} // namespace
+
+namespace pime
+{
+
+converter::converter()
+{}
+
+converter::~converter()
+{}
+
+void converter::build(const dictionary::snapshot& words)
+{
+    std::vector<const dictionary::word*> list;
+    for (const auto* word : words.flatten())
+    {
+        if (word->traditional.isEmpty() || word->traditional[0].unicode() < 0x2e80)
+            continue;
+        list.push_back(word);
+    }
+    std::stable_sort(std::begin(list), std::end(list),
+        [](const dictionary::word* lhs, const dictionary::word* rhs) {
+            return lhs->frequency > rhs->frequency;
+        });
+
+    const auto traditional = [](const dictionary::word& w) { return w.traditional; };
+    const auto simplified  = [](const dictionary::word& w) { return w.simplified; };
+
+    auto entries = make_entries(list, traditional, simplified);
+    simplified_.build(entries);
+
+    entries = make_entries(list, simplified, traditional);
+    traditional_.build(entries);
+
+    qDebug() << "Built script conversion with " << simplified_.size() << " and "
+             << traditional_.size() << " phrases";
+}
+
+QString converter::convert(const QString& text, script to) const
+{
+    const auto& phrases = to == script::simplified ? simplified_ : traditional_;
+
+    QString ret;
+    ret.reserve(text.size());
+
+    const auto* data = text.constData();
+    const auto  size = text.size();
+    for (int i=0; i<size; )
+    {
+        const QString* phrase = nullptr;
+        const auto len = phrases.match(data + i, size - i, phrase);
+        if (len == 0)
+        {
+            ret.append(data[i++]);
+            continue;
+        }
+        ret.append(*phrase);
+        i += len;
+    }
+    return ret;
+}
+
+void converter::convert(QTextStream& in, QTextStream& out, script to) const
+{
+    while (!in.atEnd())
+    {
+        out << convert(in.readLine(), to);
+        out << "\n";
+    }
+    out.flush();
+}
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,68 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#include "warnpop.h"
+#include "dictionary.h"
+#include "trie.h"
+
+class QTextStream;
+
+namespace pime
+{
+    // convert text between the traditional and simplified scripts.
+    // the text is converted a phrase at a time using the longest words
+    // found in the dictionary, since many simplified characters stand
+    // for several traditional ones and only the phrase tells which.
+    // the characters that aren't part of any longer word are mapped
+    // to the counterpart that is used the most in the frequent words.
+    class converter
+    {
+    public:
+        enum class script {
+            traditional, simplified
+        };
+
+        converter();
+       ~converter();
+
+        // build the mappings from the words in the given dictionary version.
+        void build(const dictionary::snapshot& words);
+
+        // convert the text to the given script. text that isn't
+        // found in the dictionary is copied as is.
+        QString convert(const QString& text, script to) const;
+
+        // convert the input stream line by line to the output stream.
+        void convert(QTextStream& in, QTextStream& out, script to) const;
+
+    private:
+        trie simplified_;
+        trie traditional_;
+    };
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,237 @@
+// Copyright (c) 2014 Sami Väisänen, Ensisoft
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#pragma once
+
+// the compiled dictionary file format. this is shared between the
+// cedict tool which produces the files and the application which
+// loads them. the file contains everything the application would
+// otherwise compute at load time, i.e. the normalized lookup keys,
+// the toned pinyin, the word frequencies and the key order.
+//
+// layout:
+//   header
+//   record[header.word_count]   (sorted by key)
+//   char16_t[header.pool_size]  (string pool, UTF-16)
+//
+// all offsets are relative to the start of the file so the image can be
+// used from any address. the data is in host byte order, the byteorder
+// field in the header is used to detect files built on another platform.
+// the header has the checksums of the frequency tables that the record
+// frequencies were computed from so that the application can tell whether
+// they agree with the tables it has loaded itself.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+namespace dicfile
+{
+    const char MAGIC[8] = {'P', 'I', 'M', 'E', 'D', 'I', 'C', '\0'};
+    const std::uint32_t VERSION   = 2;
+    const std::uint32_t BYTEORDER = 0x01020304;
+
+    struct header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteorder;
+        std::uint32_t word_count;
+        std::uint32_t record_offset;
+        std::uint32_t pool_offset;
+        std::uint32_t pool_size;
+        // the checksums of the character and the word frequency
+        // table files or 0 when the table wasn't used.
+        std::uint32_t char_table;
+        std::uint32_t word_table;
+    };
+
+    // a string in the string pool. offset and length are in UTF-16 code units.
+    struct string {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    struct record {
+        string key;
+        string traditional;
+        string simplified;
+        string pinyin;
+        string definition;
+        std::uint32_t frequency;
+    };
+
+    // compute the checksum (32bit FNV-1a) of a frequency table file. pass the
+    // previous checksum as the seed to continue over several files.
+    inline std::uint32_t checksum(const void* data, std::size_t size, std::uint32_t seed = 0)
+    {
+        std::uint32_t hash = seed ? seed : 2166136261u;
+        const auto* p = static_cast<const unsigned char*>(data);
+        for (std::size_t i=0; i<size; ++i)
+        {
+            hash ^= p[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // check whether the given data starts with a compiled dictionary header.
+    inline bool is_compiled(const void* data, std::size_t size)
+    {
+        if (size < sizeof(MAGIC))
+            return false;
+        return !std::memcmp(data, MAGIC, sizeof(MAGIC));
+    }
+
+    // validate the image and return a pointer to the header
+    // or nullptr if the image isn't a valid compiled dictionary.
+    // every string of every record is checked to be within the pool.
+    inline const header* open(const void* data, std::size_t size)
+    {
+        if (size < sizeof(header) || !is_compiled(data, size))
+            return nullptr;
+
+        const auto* head = static_cast<const header*>(data);
+        if (head->version != VERSION || head->byteorder != BYTEORDER)
+            return nullptr;
+
+        const std::uint64_t records = std::uint64_t(head->word_count) * sizeof(record);
+        const std::uint64_t pool    = std::uint64_t(head->pool_size) * sizeof(char16_t);
+        if (head->record_offset + records > size)
+            return nullptr;
+        if (head->pool_offset + pool > size)
+            return nullptr;
+
+        // the strings are used straight from the pool so each one
+        // has to be within it even if the file is corrupt.
+        const auto valid = [=](const string& s) {
+            return std::uint64_t(s.offset) + s.length <= head->pool_size;
+        };
+        const auto* recs = reinterpret_cast<const record*>(
+            static_cast<const char*>(data) + head->record_offset);
+        for (std::uint32_t i=0; i<head->word_count; ++i)
+        {
+            const auto& rec = recs[i];
+            if (!valid(rec.key) || !valid(rec.traditional) || !valid(rec.simplified) ||
+                !valid(rec.pinyin) || !valid(rec.definition))
+                return nullptr;
+        }
+        return head;
+    }
+
+    inline const record* records(const header* head)
+    {
+        const auto* base = reinterpret_cast<const char*>(head);
+        return reinterpret_cast<const record*>(base + head->record_offset);
+    }
+
+    inline const char16_t* pool(const header* head)
+    {
+        const auto* base = reinterpret_cast<const char*>(head);
+        return reinterpret_cast<const char16_t*>(base + head->pool_offset);
+    }
+
+    // collect words and produce a compiled dictionary image.
+    // identical strings are stored only once in the string pool.
+    class builder
+    {
+    public:
+        void add(const std::u16string& key,
+            const std::u16string& traditional,
+            const std::u16string& simplified,
+            const std::u16string& pinyin,
+            const std::u16string& definition,
+            std::uint32_t frequency)
+        {
+            entry e;
+            e.key = key;
+            e.rec.key         = intern(key);
+            e.rec.traditional = intern(traditional);
+            e.rec.simplified  = intern(simplified);
+            e.rec.pinyin      = intern(pinyin);
+            e.rec.definition  = intern(definition);
+            e.rec.frequency   = frequency;
+            entries_.push_back(e);
+        }
+
+        std::size_t size() const
+        { return entries_.size(); }
+
+        // build the file image. the records are stably sorted by key
+        // so that words with equal keys keep the order they were added in.
+        // the checksums are those of the tables the frequencies came from.
+        std::string finish(std::uint32_t char_table = 0, std::uint32_t word_table = 0)
+        {
+            std::stable_sort(std::begin(entries_), std::end(entries_),
+                [](const entry& lhs, const entry& rhs) {
+                    return lhs.key < rhs.key;
+                });
+
+            header head;
+            std::memcpy(head.magic, MAGIC, sizeof(MAGIC));
+            head.version       = VERSION;
+            head.byteorder     = BYTEORDER;
+            head.word_count    = entries_.size();
+            head.record_offset = sizeof(header);
+            head.pool_offset   = sizeof(header) + entries_.size() * sizeof(record);
+            head.pool_size     = pool_.size();
+            head.char_table    = char_table;
+            head.word_table    = word_table;
+
+            std::string ret;
+            ret.reserve(head.pool_offset + pool_.size() * sizeof(char16_t));
+            ret.append(reinterpret_cast<const char*>(&head), sizeof(head));
+            for (const auto& e : entries_)
+                ret.append(reinterpret_cast<const char*>(&e.rec), sizeof(e.rec));
+            ret.append(reinterpret_cast<const char*>(pool_.data()),
+                pool_.size() * sizeof(char16_t));
+            return ret;
+        }
+
+    private:
+        string intern(const std::u16string& str)
+        {
+            auto it = strings_.find(str);
+            if (it != std::end(strings_))
+                return it->second;
+
+            string s;
+            s.offset = pool_.size();
+            s.length = str.size();
+            pool_.insert(std::end(pool_), std::begin(str), std::end(str));
+            strings_.insert(std::make_pair(str, s));
+            return s;
+        }
+
+    private:
+        struct entry {
+            std::u16string key;
+            record rec;
+        };
+        std::vector<entry> entries_;
+        std::vector<char16_t> pool_;
+        std::unordered_map<std::u16string, string> strings_;
+    };
+
+} // dicfile
@@ -29,8 +29,18 @@
 #  include "pinyin.h"
 #include "warnpop.h"
 #include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <set>
+#include <unordered_set>
 
 #include "dictionary.h"
+#include "dicfile.h"
+#include "freqtable.h"
+#include "wordtable.h"
+#include "savefile.h"
+#include "textfile.h"
+#include "memusage.h"
 #include "format.h"
 
 QString make_dictionary_key(const QString& pinyin)
@@ -44,6 +54,117 @@ QString make_dictionary_key(const QString& pinyin)
     return QString::fromStdWString(ret);
 }
 
+std::u16string make_dictionary_string(const QString& str)
+{
+    const auto* beg = reinterpret_cast<const char16_t*>(str.unicode());
+    return std::u16string(beg, beg + str.size());
+}
+
+// make the abbreviation of the key from the initial letter of each
+// syllable, i.e. "zhongguo" becomes "zg". the syllables are not always
+// separated so a new syllable is assumed to start at every consonant
+// that isn't part of a zh/ch/sh initial or a n/ng/r final.
+QString make_dictionary_initials(const QString& key)
+{
+    const auto& str = key.toLower();
+    const auto vowel = [&](int i) {
+        if (i >= str.size())
+            return false;
+        const auto c = str[i].unicode();
+        return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' || c == 'v' ||
+               c == pinyin::u_diaresis_latin;
+    };
+
+    QString ret;
+    int syllable = -1;
+    for (int i=0; i<str.size(); ++i)
+    {
+        const auto c = str[i].unicode();
+        if (!str[i].isLetter())
+        {
+            syllable = -1;
+            continue;
+        }
+        if (syllable == -1)
+        {
+            ret.push_back(str[i]);
+            syllable = i;
+            continue;
+        }
+        if (vowel(i))
+            continue;
+
+        const auto first = str[syllable].unicode();
+        if (c == 'h' && i == syllable + 1 && (first == 'z' || first == 'c' || first == 's'))
+            continue;
+        if ((c == 'n' || c == 'r') && !vowel(i+1))
+            continue;
+        if (c == 'g' && str[i-1] == 'n' && !vowel(i+1))
+            continue;
+
+        ret.push_back(str[i]);
+        syllable = i;
+    }
+    return ret;
+}
+
+// check whether the string is made of Chinese characters only, i.e.
+// the CJK unified ideographs, their extension A, the compatibility
+// ideographs and the surrogates of the extensions outside the BMP.
+bool is_hanzi(const QString& str)
+{
+    for (const auto& c : str)
+    {
+        const auto u = c.unicode();
+        if ((u >= 0x3400 && u <= 0x4dbf) || (u >= 0x4e00 && u <= 0x9fff) ||
+            (u >= 0xf900 && u <= 0xfaff) || (u >= 0xd800 && u <= 0xdfff))
+            continue;
+        return false;
+    }
+    return true;
+}
+
+// make the character bigrams of the string. with unigrams the
+// single characters are included too.
+std::vector<quint32> make_grams(const QString& str, bool unigrams)
+{
+    std::vector<quint32> ret;
+    for (int i=0; i<str.size(); ++i)
+    {
+        const quint32 c = str[i].unicode();
+        if (unigrams)
+            ret.push_back(c);
+        if (i + 1 < str.size())
+            ret.push_back(c << 16 | str[i+1].unicode());
+    }
+    std::sort(std::begin(ret), std::end(ret));
+    ret.erase(std::unique(std::begin(ret), std::end(ret)), std::end(ret));
+    return ret;
+}
+
+// map the whole file for reading. the mapping is valid for the lifetime
+// of the QFile object. on windows a file can't be replaced while it's
+// mapped and the dictionary keeps its mappings until it's destroyed,
+// so the files that are saved back would be stuck. there the files
+// are always read instead.
+const char* map_file(QFile& file)
+{
+#if defined(_WIN32)
+    qDebug() << "Not mapping " << file.fileName() << " reading it instead.";
+    return nullptr;
+#else
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr;
+    const auto size = file.size();
+    if (!size)
+        return nullptr;
+    const auto* data = file.map(0, size);
+    if (!data)
+        qDebug() << "Failed to map " << file.fileName() << " reading it instead.";
+    return reinterpret_cast<const char*>(data);
+#endif
+}
+
 QString make_dictionary_syllable(const QString& key, int tone)
 {
     std::wstring wide = key.toStdWString();
@@ -54,37 +175,159 @@ QString make_dictionary_syllable(const QString& key, int tone)
 namespace pime
 {
 
-dictionary::dictionary() : wordguid_(1)
-{}
+dictionary::dictionary() : wordguid_(1), compact_(false), lazy_(false), charfreq_(nullptr), wordfreq_(nullptr)
+{
+    std::shared_ptr<snapshot> first(new snapshot);
+    first->generation_ = 1;
+    first->owner_ = this;
+    current_ = first;
+}
 
 dictionary::~dictionary()
 {}
 
+dictionary::version dictionary::current() const
+{
+    // not lock-free, the library guards the shared_ptr with a lock
+    // of its own that's only held for copying the pointer.
+    return std::atomic_load(&current_);
+}
+
 void dictionary::load(const QString& file, quint32 metakey)
+{
+    // read the file without holding the writer lock and then
+    // add the new words to a version of their own.
+    std::shared_ptr<layer> words(new layer);
+    read(*words, file, metakey);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto next = copy();
+    auto& ptr = next->layers_[metakey];
+    if (!ptr)
+        ptr = words;
+    else
+    {
+        // more words for an existing source are copied in.
+        auto& layer = next->edit(metakey);
+        for (const auto& entry : words->index)
+        {
+            const auto* added = layer.add(*entry.second);
+            layer.index.push_back(std::make_pair(entry.first, added));
+            layer.link(added);
+        }
+        layer.images.insert(std::end(layer.images), std::begin(words->images), std::end(words->images));
+        layer.sort();
+    }
+    next->modified_[metakey] = next->generation_;
+    publish(next);
+}
+
+quint32 dictionary::reload(const QString& file, quint32 metakey)
+{
+    const auto modified = current()->modified(metakey);
+
+    // build the layer again from scratch without holding the writer lock
+    // and swap it in with a single version so that the readers never see
+    // it half done and the other writers only wait for the swap.
+    std::shared_ptr<layer> words(new layer);
+    read(*words, file, metakey);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // a change made while reading would be lost without a trace.
+    if (current_->modified(metakey) != modified)
+        throw std::runtime_error(utf8("dictionary was modified while reloading: _1", file));
+
+    auto next = copy();
+    next->layers_[metakey] = words;
+    next->modified_[metakey] = next->generation_;
+    publish(next);
+
+    qDebug() << "Reloaded" << file << "with" << words->index.size() << "words";
+    return next->generation_;
+}
+
+void dictionary::read(layer& layer, const QString& file, quint32 metakey)
 {
     QFile io(file);
     if (!io.open(QIODevice::ReadOnly))
         throw std::runtime_error(utf8("open dictionary failed: _1", file));
 
-    QTextStream stream(&io);
-    stream.setCodec("UTF-8");
-    while (!stream.atEnd())
+    // the words are appended to the index in the file order and
+    // sorted once the whole file has been read.
+    parse(layer, io, file, metakey);
+    layer.sort();
+}
+
+void dictionary::parse(layer& layer, QFile& io, const QString& file, quint32 metakey)
+{
+    const auto& magic = io.peek(sizeof(dicfile::MAGIC));
+    if (dicfile::is_compiled(magic.constData(), magic.size()))
     {
-        const auto& line = stream.readLine();
-        const auto& toks = line.split("|");
-        const auto& key  = make_dictionary_key(toks[2]);
-        const auto index = words_.size();        
+        // map the file instead of reading it so that all the instances
+        // running on the machine share the pages of the strings. the
+        // records and the index are still built in each process.
+        std::shared_ptr<image> data(new image);
+        data->mapping.reset(new QFile(file));
+        data->data = map_file(*data->mapping);
+        if (data->data)
+            data->size = data->mapping->size();
+        else
+        {
+            data->mapping.reset();
+            data->buffer = io.readAll();
+            data->data   = data->buffer.constData();
+            data->size   = data->buffer.size();
+        }
+        loadCompiled(layer, file, data, metakey);
+        return;
+    }
+
+    if (lazy_)
+    {
+        // the file is kept in memory as it is which is still much
+        // smaller than the decoded definitions. it's copied rather
+        // than mapped since the text files are edited in place.
+        std::shared_ptr<image> text(new image);
+        text->buffer = io.readAll();
+        text->data   = text->buffer.constData();
+        text->size   = text->buffer.size();
+        loadLazy(layer, file, text, metakey);
+        return;
+    }
+
+    // in compact mode share the identical strings. most words are the
+    // same in traditional and simplified and the homophones share
+    // the pinyin and the key.
+    std::set<QString> strings;
+    const auto intern = [&](const QString& str) {
+        if (!compact_)
+            return str;
+        return *strings.insert(str).first;
+    };
+
+    textfile text(file);
+    while (text.next())
+    {
+        // trad|simp|pinyin|definition, the definition can contain '|'
+        textfile::field toks[4];
+        if (!text.split('|', toks, 4))
+            throw text.error("unexpected dictionary data");
+
+        const auto& pinyin = intern(toks[2].toString());
+        const auto& key    = intern(make_dictionary_key(pinyin));
 
         dictionary::word word;
         word.key         = key;
-        word.traditional = toks[0];
-        word.simplified  = toks[1];
-        word.pinyin      = toks[2];
-        word.description = toks[3];
+        word.traditional = toks[0].toString();
+        word.simplified  = toks[1] == toks[0] ? word.traditional : toks[1].toString();
+        word.pinyin      = pinyin;
         word.guid        = wordguid_++;
         word.meta        = metakey;
         word.erased      = false;
-        word.frequency   = 0;
+        word.frequency   = frequency(word);
+        define(word, toks[3].toString());
 
         // bool duplicate = false;
         // auto lower = words_.lower_bound(key);
@@ -98,62 +341,389 @@ void dictionary::load(const QString& file, quint32 metakey)
         //     }
         // }
         //if (!duplicate)
-        words_.push_back(word);
-        index_.insert(std::make_pair(key, index));
+        const auto* added = layer.add(word);
+        layer.index.push_back(std::make_pair(key, added));
+        layer.link(added);
     }
 }
 
-void dictionary::save(const QString& file, quint32 metakey)
+void dictionary::snapshot::save(const QString& file, quint32 metakey) const
 {
-    QFile io(file);
-    if (!io.open(QIODevice::WriteOnly | QIODevice::Truncate))
-        throw std::runtime_error(utf8("save dictionary failed: _1", file));
+    savefile io(file);
 
-    QTextStream stream(&io);
+    QTextStream stream(io.device());
     stream.setCodec("UTF-8");
 
-    auto beg = index_.begin();
-    auto end = index_.end();
-    for (; beg != end; ++beg)
+    const auto& words = select(metakey);
+    const auto& descs = owner_->describe(words);
+    for (std::size_t i=0; i<words.size(); ++i)
     {
-        const auto& key  = beg->first;
-        const auto& word = words_[beg->second];
-        if (word.meta != metakey)
-            continue;
-        if (word.erased)
-            continue;
-        stream << word.traditional << "|" << word.simplified << "|" << word.pinyin << "|" << word.description;
+        const auto& word = *words[i];
+        stream << word.traditional << "|" << word.simplified << "|" << word.pinyin << "|" << descs[i];
         stream << "\n";
     }
+    stream.flush();
+    if (stream.status() != QTextStream::Ok)
+        throw std::runtime_error(utf8("save dictionary failed: _1", file));
+
+    io.commit();
+}
+
+void dictionary::snapshot::compile(const QString& file, quint32 metakey) const
+{
+    dicfile::builder builder;
+
+    const auto& words = select(metakey);
+    const auto& descs = owner_->describe(words);
+    for (std::size_t i=0; i<words.size(); ++i)
+    {
+        const auto& word = *words[i];
+        builder.add(
+            make_dictionary_string(word.key),
+            make_dictionary_string(word.traditional),
+            make_dictionary_string(word.simplified),
+            make_dictionary_string(word.pinyin),
+            make_dictionary_string(descs[i]),
+            word.frequency);
+    }
+
+    // the frequencies of the words come from the tables of the owner.
+    const auto& image = builder.finish(
+        owner_->charfreq_ ? owner_->charfreq_->checksum() : 0,
+        owner_->wordfreq_ ? owner_->wordfreq_->checksum() : 0);
+
+    // the file might be mapped by this or some other process. truncating
+    // it would pull the pages from under them but replacing the file
+    // leaves the existing mappings with the old data.
+    savefile io(file);
+    if (io.device()->write(image.data(), image.size()) != (qint64)image.size())
+        throw std::runtime_error(utf8("save dictionary failed: _1", file));
+
+    io.commit();
+}
+
+void dictionary::loadCompiled(layer& layer, const QString& file, std::shared_ptr<image> image, quint32 metakey)
+{
+    const auto* head = dicfile::open(image->data, image->size);
+    if (!head)
+        throw std::runtime_error(utf8("unsupported or corrupt dictionary file: _1", file));
+
+    // the words are made out of the image data.
+    layer.images.push_back(image);
+
+    // the compiled frequencies are good as they are when they were
+    // computed from the same tables or when there are no tables.
+    const bool tables = (!charfreq_ && !wordfreq_) ||
+        (head->char_table == (charfreq_ ? charfreq_->checksum() : 0) &&
+         head->word_table == (wordfreq_ ? wordfreq_->checksum() : 0));
+    if (!tables)
+        qDebug() << "Recomputing the word frequencies of" << file;
+
+    const auto* records = dicfile::records(head);
+    const auto* pool    = reinterpret_cast<const QChar*>(dicfile::pool(head));
+    const auto str = [=](const dicfile::string& s) {
+        return QString::fromRawData(pool + s.offset, s.length);
+    };
+
+    // the records are already sorted by key so the index
+    // doesn't need sorting afterwards.
+    layer.index.reserve(layer.index.size() + head->word_count);
+    for (std::uint32_t i=0; i<head->word_count; ++i)
+    {
+        const auto& rec  = records[i];
+
+        dictionary::word word;
+        word.key         = str(rec.key);
+        word.traditional = str(rec.traditional);
+        word.simplified  = rec.simplified.offset == rec.traditional.offset
+                           ? word.traditional : str(rec.simplified);
+        word.pinyin      = str(rec.pinyin);
+        word.description = str(rec.definition);
+        word.definition  = word::NoDefinition;
+        word.source      = nullptr;
+        word.guid        = wordguid_++;
+        word.meta        = metakey;
+        word.erased      = false;
+        word.frequency   = tables ? rec.frequency : frequency(word);
+
+        const auto* added = layer.add(word);
+        layer.index.push_back(std::make_pair(word.key, added));
+        layer.link(added);
+    }
+}
+
+void dictionary::loadLazy(layer& layer, const QString& file, std::shared_ptr<image> text, quint32 metakey)
+{
+    // the definitions are read from the text on demand.
+    layer.images.push_back(text);
+
+    textfile lines(file, text->data, text->size);
+    while (lines.next())
+    {
+        // trad|simp|pinyin|definition, the definition can contain '|'
+        textfile::field toks[4];
+        if (!lines.split('|', toks, 4))
+            throw lines.error("unexpected dictionary data");
+
+        const auto& pinyin = toks[2].toString();
+
+        dictionary::word word;
+        word.key         = make_dictionary_key(pinyin);
+        word.traditional = toks[0].toString();
+        word.simplified  = toks[1].toString();
+        word.pinyin      = pinyin;
+        word.definition  = lines.offset(toks[3].data);
+        word.source      = text.get();
+        word.guid        = wordguid_++;
+        word.meta        = metakey;
+        word.erased      = false;
+        if (word.simplified == word.traditional)
+            word.simplified = word.traditional;
+        word.frequency   = frequency(word);
+
+        const auto* added = layer.add(word);
+        layer.index.push_back(std::make_pair(word.key, added));
+        layer.link(added);
+    }
+}
+
+std::size_t dictionary::apply(const QString& file, quint32 metakey)
+{
+    // read the whole delta before taking the writer lock.
+    struct change {
+        char op;
+        QString key;
+        QString trad;
+        QString simp;
+        QString pinyin;
+        QString desc;
+    };
+    std::vector<change> changes;
+
+    textfile text(file);
+    while (text.next())
+    {
+        // op|trad|simp|pinyin|definition, the definition can contain '|'
+        textfile::field toks[5];
+        if (!text.split('|', toks, 5))
+            throw text.error("unexpected delta data");
+        if (toks[0].size != 1 || toks[1].isEmpty() || toks[2].isEmpty() || toks[3].isEmpty())
+            throw text.error("unexpected delta data");
+        const auto op = toks[0].data[0];
+        if (op != '+' && op != '-' && op != '~')
+            throw text.error("unexpected delta data");
+
+        change c;
+        c.op     = op;
+        c.trad   = toks[1].toString();
+        c.simp   = toks[2] == toks[1] ? c.trad : toks[2].toString();
+        c.pinyin = toks[3].toString();
+        c.desc   = toks[4].toString();
+        c.key    = make_dictionary_key(c.pinyin);
+        changes.push_back(c);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto next = copy();
+    auto& layer = next->edit(metakey);
+    auto& index = layer.index;
+
+    std::size_t count = 0;
+
+    for (const auto& c : changes)
+    {
+        const auto& key    = c.key;
+        const auto& trad   = c.trad;
+        const auto& simp   = c.simp;
+        const auto& pinyin = c.pinyin;
+        const auto& desc   = c.desc;
+
+        // find the matching word, prefer the one with the same definition.
+        auto match = index.end();
+        auto range = layer.find(key);
+        auto lower = range.first;
+        auto upper = range.second;
+        for (; lower != upper; ++lower)
+        {
+            const auto& w = *lower->second;
+            if (w.meta != metakey)
+                continue;
+            if (w.traditional != trad || w.simplified != simp || w.pinyin != pinyin)
+                continue;
+            if (description(w) == desc)
+            {
+                match = lower;
+                break;
+            }
+            if (match == index.end())
+                match = lower;
+        }
+
+        const auto action = c.op;
+        if (action == '-')
+        {
+            // only remove the exact word so that applying the delta
+            // again doesn't remove a duplicate with another definition.
+            if (match == index.end() || description(*match->second) != desc)
+                continue;
+            layer.unlink(match->second);
+            index.erase(match);
+            layer.replaced++;
+        }
+        else if (action == '+' || action == '~')
+        {
+            if (match != index.end())
+            {
+                const auto& w = *match->second;
+                if (description(w) == desc)
+                    continue;
+                if (action == '~')
+                {
+                    // the words are never changed in place, 
+                    // replace it with an updated copy.
+                    auto* updated = layer.add(w);
+                    define(*updated, desc);
+                    layer.unlink(match->second);
+                    match->second = updated;
+                    layer.link(updated);
+                    layer.replaced++;
+                    ++count;
+                    continue;
+                }
+            }
+
+            dictionary::word word;
+            word.key         = key;
+            word.traditional = trad;
+            word.simplified  = simp;
+            word.pinyin      = pinyin;
+            define(word, desc);
+            word.guid        = wordguid_++;
+            word.meta        = metakey;
+            word.erased      = false;
+            word.frequency   = frequency(word);
+            auto* added = layer.add(word);
+            layer.insert(added);
+            layer.link(added);
+        }
+
+        ++count;
+    }
+    if (!count)
+        return 0;
+
+    next->modified_[metakey] = next->generation_;
+    layer.compact();
+    publish(next);
+    return count;
 }
 
-std::vector<const dictionary::word*> dictionary::lookup(const QString& key) const
+std::vector<const dictionary::word*> dictionary::snapshot::lookup(const QString& key) const
 {
+    std::vector<range> ranges;
+
+    for (const auto& pair : layers_)
+    {
+        const auto& index = pair.second->index;
+        auto lower = std::lower_bound(index.begin(), index.end(), key,
+            [](const layer::entry& e, const QString& key) {
+                return e.first < key;
+            });
+        auto upper = lower;
+        for (; upper != index.end(); ++upper)
+        {
+            if (!upper->first.startsWith(key))
+                break;
+        }
+        if (lower != upper)
+            ranges.push_back(std::make_pair(lower, upper));
+    }
+
     std::vector<const word*> ret;
+    merge(ranges, ret);
+    return ret;
+}
 
-    auto lower = index_.lower_bound(key);
-    auto upper = index_.end();
-    for (; lower != upper; ++lower)
+std::vector<const dictionary::word*> dictionary::snapshot::lookupInitials(const QString& initials) const
+{
+    const auto& key = initials.toLower();
+
+    std::vector<const word*> ret;
+    for (const auto& pair : layers_)
     {
-        const auto& k = lower->first;
-        if (!k.startsWith(key))
-            break;
-        ret.push_back(&words_[lower->second]);
+        const auto& initials = pair.second->lookups().initials;
+        auto it = initials.find(key);
+        if (it == std::end(initials))
+            continue;
+        ret.insert(std::end(ret), std::begin(it->second), std::end(it->second));
+    }
+    // each layer is already sorted, the stable sort keeps the
+    // words with equal frequency in the layer order.
+    if (ret.size() != 0 && layers_.size() > 1)
+    {
+        std::stable_sort(std::begin(ret), std::end(ret),
+            [](const word* lhs, const word* rhs) {
+                return lhs->frequency > rhs->frequency;
+            });
     }
+    return ret;
+}
 
+std::vector<const dictionary::word*> dictionary::snapshot::lookupSimplified(const QString& hanzi) const
+{
+    std::vector<const word*> ret;
+    for (const auto& pair : layers_)
+    {
+        const auto& simplified = pair.second->lookups().simplified;
+        auto it = simplified.find(hanzi);
+        if (it == std::end(simplified))
+            continue;
+        ret.insert(std::end(ret), std::begin(it->second), std::end(it->second));
+    }
     return ret;
 }
 
-std::vector<const dictionary::word*> dictionary::search(const QString& str) const
+std::vector<const dictionary::word*> dictionary::snapshot::search(const QString& str) const
 {
     std::vector<const word*> ret;
 
-    auto beg = index_.begin();
-    auto end = index_.end();
-    for (; beg != end; ++beg)
+    if (!str.isEmpty() && is_hanzi(str))
     {
-        const auto& word = words_[beg->second];
-        if (word.description.indexOf(str) != -1)
+        // the hanzi of the words are found through the index but the
+        // definitions mention hanzi too (e.g. the cross references) so
+        // the rest of the words still have their definitions searched.
+        const auto& hits = searchHanzi(str);
+        std::unordered_set<const word*> found(std::begin(hits), std::end(hits));
+
+        const auto& words = flatten();
+        std::vector<const word*> rest;
+        for (const auto* word : words)
+        {
+            if (!found.count(word))
+                rest.push_back(word);
+        }
+        const auto& descs = owner_->describe(rest);
+        for (std::size_t i=0; i<rest.size(); ++i)
+        {
+            if (descs[i].indexOf(str) != -1)
+                found.insert(rest[i]);
+        }
+        // in the same order as the other searches.
+        for (const auto* word : words)
+        {
+            if (found.count(word))
+                ret.push_back(word);
+        }
+        return ret;
+    }
+
+    const auto& words = flatten();
+    const auto& descs = owner_->describe(words);
+    for (std::size_t i=0; i<words.size(); ++i)
+    {
+        const auto& word = *words[i];
+        if (descs[i].indexOf(str) != -1)
             ret.push_back(&word);
         else if (word.traditional.indexOf(str) != -1)
             ret.push_back(&word);
@@ -164,45 +734,160 @@ std::vector<const dictionary::word*> dictionary::search(const QString& str) cons
     return ret;
 }
 
-std::vector<const dictionary::word*> dictionary::flatten() const
+std::vector<const dictionary::word*> dictionary::snapshot::searchHanzi(const QString& str) const
 {
+    const auto& keys = make_grams(str, str.size() == 1);
+
     std::vector<const word*> ret;
+    for (const auto& pair : layers_)
+    {
+        const auto& grams = pair.second->grams();
+
+        // intersect the posting lists starting from the shortest.
+        typedef std::vector<layer::gram>::const_iterator iterator;
+        std::vector<std::pair<iterator, iterator>> lists;
+        for (const auto key : keys)
+        {
+            lists.push_back(std::equal_range(grams.begin(), grams.end(),
+                layer::gram(key, nullptr),
+                [](const layer::gram& lhs, const layer::gram& rhs) {
+                    return lhs.first < rhs.first;
+                }));
+        }
+        std::sort(std::begin(lists), std::end(lists),
+            [](const std::pair<iterator, iterator>& lhs, const std::pair<iterator, iterator>& rhs) {
+                return (lhs.second - lhs.first) < (rhs.second - rhs.first);
+            });
+
+        std::vector<const word*> candidates;
+        for (auto it = lists[0].first; it != lists[0].second; ++it)
+            candidates.push_back(it->second);
+        for (std::size_t i=1; i<lists.size() && !candidates.empty(); ++i)
+        {
+            std::vector<const word*> next;
+            auto it = lists[i].first;
+            const auto end = lists[i].second;
+            for (const auto* word : candidates)
+            {
+                it = std::lower_bound(it, end, word,
+                    [](const layer::gram& g, const dictionary::word* w) {
+                        return g.second < w;
+                    });
+                if (it == end)
+                    break;
+                if (it->second == word)
+                    next.push_back(word);
+            }
+            candidates.swap(next);
+        }
+
+        // the grams only tell that the characters are there,
+        // check that they're next to each other in order.
+        for (const auto* word : candidates)
+        {
+            if (word->traditional.indexOf(str) != -1 || word->simplified.indexOf(str) != -1)
+                ret.push_back(word);
+        }
+    }
+    return ret;
+}
+
+std::vector<const dictionary::word*> dictionary::snapshot::flatten() const
+{
+    std::vector<range> ranges;
 
-    for (const auto& pair : index_)
-        ret.push_back(&words_[pair.second]);
+    for (const auto& pair : layers_)
+    {
+        const auto& index = pair.second->index;
+        if (!index.empty())
+            ranges.push_back(std::make_pair(index.begin(), index.end()));
+    }
+
+    std::vector<const word*> ret;
+    merge(ranges, ret);
+    return ret;
+}
 
+std::size_t dictionary::snapshot::wordCount() const
+{
+    std::size_t ret = 0;
+    for (const auto& pair : layers_)
+        ret += pair.second->index.size();
     return ret;
 }
 
+void dictionary::snapshot::merge(std::vector<range>& ranges, std::vector<const word*>& ret)
+{
+    if (ranges.size() == 1)
+    {
+        for (auto it = ranges[0].first; it != ranges[0].second; ++it)
+            ret.push_back(it->second);
+        return;
+    }
+
+    // there's only a handful of layers so a linear scan for the
+    // smallest key is good enough. on equal keys the first layer wins.
+    while (!ranges.empty())
+    {
+        std::size_t min = 0;
+        for (std::size_t i=1; i<ranges.size(); ++i)
+        {
+            if (ranges[i].first->first < ranges[min].first->first)
+                min = i;
+        }
+        auto& r = ranges[min];
+        ret.push_back(r.first->second);
+        if (++r.first == r.second)
+            ranges.erase(ranges.begin() + min);
+    }
+}
+
 bool dictionary::store(dictionary::word& word)
 {
     Q_ASSERT(!word.traditional.isEmpty());
     Q_ASSERT(!word.simplified.isEmpty());
     Q_ASSERT(!word.pinyin.isEmpty());
 
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto next = copy();
+
     word.key = make_dictionary_key(word.pinyin);
 
-    auto lower = index_.lower_bound(word.key);
-    auto upper = index_.upper_bound(word.key);
-    for (; lower != upper; ++lower)
+    auto& layer = next->edit(word.meta);
+    auto range = layer.find(word.key);
+    for (auto lower = range.first; lower != range.second; ++lower)
     {
-        auto& w = words_[lower->second];
+        const auto& w = *lower->second;
         if (w.guid != word.guid)
             continue;
 
-        w.traditional = word.traditional;
-        w.simplified  = word.simplified;
-        w.pinyin      = word.pinyin;
-        w.description = word.description;
+        // the words are never changed in place, replace it with an updated copy.
+        auto& updated = *layer.add(w);
+        updated.traditional = word.traditional;
+        updated.simplified  = word.simplified;
+        updated.pinyin      = word.pinyin;
+        updated.frequency   = frequency(updated);
+        define(updated, word.description);
+        layer.unlink(lower->second);
+        lower->second = &updated;
+        layer.link(&updated);
+        layer.replaced++;
+        layer.compact();
+        next->modified_[updated.meta] = next->generation_;
+        publish(next);
         qDebug() << "Updated word: " << word.key << "Pinyin: " << word.pinyin << "Ch: " << word.traditional;
         return true;
     }
 
-    const auto index = words_.size();
-
-    word.guid = wordguid_++;
-    index_.insert(std::make_pair(word.key, index));
-    words_.push_back(word);
+    word.guid      = wordguid_++;
+    word.frequency = frequency(word);
+    auto* added = layer.add(word);
+    define(*added, word.description);
+    layer.insert(added);
+    layer.link(added);
+    next->modified_[word.meta] = next->generation_;
+    publish(next);
 
     qDebug() << "Stored new word: " << word.key << "Pinyin: " << word.pinyin << " Ch: " << word.traditional;
     return false;
@@ -213,19 +898,473 @@ bool dictionary::erase(const dictionary::word& word)
     Q_ASSERT(!word.key.isEmpty());
     Q_ASSERT(word.guid);
 
-    auto lower = index_.lower_bound(word.key);
-    auto upper = index_.upper_bound(word.key);
-    for (; lower != upper; ++lower)
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = current_->layers_.find(word.meta);
+    if (it == std::end(current_->layers_))
+        return false;
+
+    auto next = copy();
+
+    auto& layer = next->edit(word.meta);
+    auto range = layer.find(word.key);
+    for (auto lower = range.first; lower != range.second; ++lower)
     {
-        const auto& w = words_[lower->second];
+        const auto& w = *lower->second;
         if (w.guid != word.guid)
             continue;
 
-        words_[lower->second].erased = true;
-        index_.erase(lower);
+        next->modified_[w.meta] = next->generation_;
+        layer.unlink(lower->second);
+        layer.index.erase(lower);
+        layer.replaced++;
+        layer.compact();
+        publish(next);
         return true;
     }
     return false;
 }
 
+void dictionary::unload(quint32 metakey)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!current_->layers_.count(metakey))
+        return;
+
+    // the words are freed with the last version that has the layer.
+    auto next = copy();
+    next->layers_.erase(metakey);
+    next->modified_.erase(metakey);
+    publish(next);
+
+    qDebug() << "Unloaded dictionary layer" << metakey;
+}
+
+QString dictionary::description(const word& w) const
+{
+    if (w.definition == word::NoDefinition)
+        return w.description;
+
+    if (w.source)
+    {
+        // the definition goes until the end of the line. the text
+        // is kept by the layers that have the word.
+        const auto* beg = w.source->data + w.definition;
+        const auto* end = w.source->data + w.source->size;
+        const auto* eol = static_cast<const char*>(std::memchr(beg, '\n', end - beg));
+        if (!eol)
+            eol = end;
+        if (eol > beg && eol[-1] == '\r')
+            --eol;
+        return QString::fromUtf8(beg, eol - beg);
+    }
+
+    std::lock_guard<std::mutex> lock(defmutex_);
+
+    const auto block = w.definition / BLOCK_SIZE;
+    const auto slot  = w.definition % BLOCK_SIZE;
+    if (block == blocks_.size())
+        return pending_[slot];
+
+    // keep the most recently used blocks decoded
+    auto it = std::find_if(std::begin(cache_), std::end(cache_),
+        [=](const std::pair<quint32, QStringList>& p) {
+            return p.first == block;
+        });
+    if (it == std::end(cache_))
+    {
+        const auto& data = qUncompress(blocks_[block]);
+        const auto& text = QString::fromUtf8(data.constData(), data.size());
+        cache_.push_front(std::make_pair(block, text.split(QChar(0))));
+        if (cache_.size() > CACHE_SIZE)
+            cache_.pop_back();
+        it = std::begin(cache_);
+    }
+    else if (it != std::begin(cache_))
+    {
+        cache_.splice(std::begin(cache_), cache_, it);
+        it = std::begin(cache_);
+    }
+    return it->second[slot];
+}
+
+std::vector<QString> dictionary::describe(const std::vector<const word*>& words) const
+{
+    std::vector<QString> ret(words.size());
+
+    // go through the words in the order of their definitions so that
+    // each block only needs to be decoded once and the mapped files
+    // are read sequentially.
+    std::vector<std::size_t> order;
+    for (std::size_t i=0; i<words.size(); ++i)
+        order.push_back(i);
+    if (compact_ || lazy_)
+    {
+        std::sort(std::begin(order), std::end(order),
+            [&](std::size_t lhs, std::size_t rhs) {
+                const auto* a = words[lhs];
+                const auto* b = words[rhs];
+                if (a->source != b->source)
+                    return std::less<const image*>()(a->source, b->source);
+                return a->definition < b->definition;
+            });
+    }
+    for (const auto i : order)
+        ret[i] = description(*words[i]);
+
+    return ret;
+}
+
+void dictionary::define(word& w, const QString& desc)
+{
+    w.source = nullptr;
+    if (!compact_)
+    {
+        w.description = desc;
+        w.definition  = word::NoDefinition;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(defmutex_);
+
+    w.description = QString();
+    w.definition  = blocks_.size() * BLOCK_SIZE + pending_.size();
+    pending_.append(desc);
+    if (pending_.size() < (int)BLOCK_SIZE)
+        return;
+
+    blocks_.push_back(qCompress(pending_.join(QChar(0)).toUtf8()));
+    pending_.clear();
+}
+
+quint32 dictionary::frequency(const word& w) const
+{
+    // the character table has nothing to say about the words
+    // with several characters so those come from the word table.
+    if (w.simplified.size() > 1)
+        return wordfreq_ ? wordfreq_->unigram(w.simplified) : 0;
+    return charfreq_ ? charfreq_->lookup(w.simplified) : 0;
+}
+
+dictionary::memory dictionary::memoryUsage() const
+{
+    // the version has all the words and the indices, only
+    // the file data needs to be guarded from the writers.
+    const auto& version = current();
+    const auto count = version->wordCount();
+
+    memory mem;
+    mem.records     = count * sizeof(word);
+    mem.strings     = 0;
+    mem.index       = 0;
+    mem.tombstones  = 0;
+    mem.definitions = 0;
+    mem.mapped      = 0;
+
+    for (const auto& layer : version->layers_)
+    {
+        const auto& index = layer.second->index;
+        mem.index += sizeof(dictionary::layer);
+        mem.tombstones += layer.second->replaced * sizeof(word);
+        mem.index += index.capacity() * sizeof(layer::entry);
+
+        const auto* tables = layer.second->built();
+        if (!tables)
+            continue;
+        const auto& initials   = tables->initials;
+        const auto& simplified = tables->simplified;
+        for (const auto& pair : initials)
+        {
+            mem.index += node_bytes(initials);
+            mem.index += string_bytes(pair.first);
+            mem.index += pair.second.capacity() * sizeof(const word*);
+        }
+        // the keys share the strings of the words.
+        for (const auto& pair : simplified)
+        {
+            mem.index += node_bytes(simplified);
+            mem.index += pair.second.capacity() * sizeof(const word*);
+        }
+    }
+
+    // the strings are shared between the words and the index, count
+    // each one only once. the strings in the compiled images only
+    // have the header allocated.
+    std::lock_guard<std::mutex> lock(defmutex_);
+
+    // the layers that share an image are copies of each other.
+    std::unordered_set<const image*> images;
+    for (const auto& layer : version->layers_)
+    {
+        for (const auto& image : layer.second->images)
+            images.insert(image.get());
+    }
+    for (const auto* image : images)
+    {
+        if (image->mapping)
+            mem.mapped += image->size;
+        else mem.definitions += image->size;
+    }
+
+    const auto compiled = [&](const QString& str) {
+        for (const auto* image : images)
+        {
+            if (image->contains(str.constData()))
+                return true;
+        }
+        return false;
+    };
+    std::unordered_set<const QChar*> seen;
+    const auto bytes = [&](const QString& str) -> quint64 {
+        if (str.isNull() || !seen.insert(str.constData()).second)
+            return 0;
+        if (compiled(str))
+            return QSTRING_HEADER;
+        return string_bytes(str);
+    };
+    for (const auto* word : version->flatten())
+    {
+        const auto& w = *word;
+        const auto strings = bytes(w.key) + bytes(w.traditional) + bytes(w.simplified) +
+            bytes(w.pinyin) + bytes(w.description);
+        mem.strings += strings;
+        mem.metas[w.meta] += sizeof(word) + strings;
+    }
+
+    for (const auto& block : blocks_)
+        mem.definitions += block.size();
+    for (const auto& desc : pending_)
+        mem.definitions += string_bytes(desc);
+
+    return mem;
+}
+
+std::vector<const dictionary::word*> dictionary::snapshot::select(quint32 metakey) const
+{
+    std::vector<const word*> ret;
+
+    auto it = layers_.find(metakey);
+    if (it == std::end(layers_))
+        return ret;
+
+    for (const auto& pair : it->second->index)
+    {
+        const auto* word = pair.second;
+        if (word->erased)
+            continue;
+        ret.push_back(word);
+    }
+    return ret;
+}
+
+std::shared_ptr<dictionary::snapshot> dictionary::copy() const
+{
+    // only the writer replaces the current version so 
+    // there's no need for an atomic load here.
+    std::shared_ptr<snapshot> next(new snapshot(*current_));
+    next->generation_++;
+    return next;
+}
+
+void dictionary::publish(std::shared_ptr<snapshot> next)
+{
+    std::shared_ptr<const snapshot> version(std::move(next));
+    std::atomic_store(&current_, version);
+}
+
+dictionary::layer& dictionary::snapshot::edit(quint32 metakey)
+{
+    // the layer might be shared with the published versions,
+    // copy it before the first change in this version.
+    auto& ptr = layers_[metakey];
+    if (!ptr)
+        ptr = std::make_shared<layer>();
+    else if (!ptr.unique())
+        ptr = std::make_shared<layer>(*ptr);
+    return *ptr;
+}
+
+dictionary::layer::layer(const layer& other) : index(other.index), words(other.words),
+    replaced(other.replaced), images(other.images), tablesReady_(nullptr), gramsReady_(nullptr)
+{
+    // a reader might be building the tables of the other layer.
+    std::lock_guard<std::mutex> lock(other.mutex_);
+    if (other.tables_)
+    {
+        tables_.reset(new tables(*other.tables_));
+        tablesReady_.store(tables_.get(), std::memory_order_release);
+    }
+}
+
+std::pair<dictionary::layer::iterator, dictionary::layer::iterator> dictionary::layer::find(const QString& key)
+{
+    struct order {
+        bool operator()(const entry& lhs, const QString& rhs) const
+        { return lhs.first < rhs; }
+        bool operator()(const QString& lhs, const entry& rhs) const
+        { return lhs < rhs.first; }
+    };
+    return std::equal_range(index.begin(), index.end(), key, order());
+}
+
+void dictionary::layer::insert(const word* w)
+{
+    auto pos = std::upper_bound(index.begin(), index.end(), w->key,
+        [](const QString& key, const entry& e) {
+            return key < e.first;
+        });
+    index.insert(pos, std::make_pair(w->key, w));
+}
+
+void dictionary::layer::compact()
+{
+    // a few replaced words aren't worth the copying.
+    if (replaced < 64 || replaced < index.size())
+        return;
+
+    std::shared_ptr<std::deque<word>> store(new std::deque<word>);
+    std::unordered_map<const word*, const word*> moved;
+    for (auto& entry : index)
+    {
+        store->push_back(*entry.second);
+        moved[entry.second] = &store->back();
+        entry.second = &store->back();
+    }
+    if (tables_)
+    {
+        for (auto& pair : tables_->initials)
+        {
+            for (auto& w : pair.second)
+                w = moved[w];
+        }
+        for (auto& pair : tables_->simplified)
+        {
+            for (auto& w : pair.second)
+                w = moved[w];
+        }
+    }
+    words    = store;
+    replaced = 0;
+    gramsReady_.store(nullptr, std::memory_order_relaxed);
+    grams_.reset();
+}
+
+void dictionary::layer::sort()
+{
+    const auto order = [](const entry& lhs, const entry& rhs) {
+        return lhs.first < rhs.first;
+    };
+    // the compiled dictionaries are already in order.
+    if (std::is_sorted(index.begin(), index.end(), order))
+        return;
+
+    // a single sort is much cheaper than inserting the words into
+    // a tree one by one and the vector needs no node per word.
+    std::stable_sort(index.begin(), index.end(), order);
+    index.shrink_to_fit();
+}
+
+const std::vector<dictionary::layer::gram>& dictionary::layer::grams() const
+{
+    if (const auto* ready = gramsReady_.load(std::memory_order_acquire))
+        return *ready;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (grams_)
+        return *grams_;
+
+    std::unique_ptr<std::vector<gram>> grams(new std::vector<gram>);
+    for (const auto& entry : index)
+    {
+        const auto* w = entry.second;
+        auto keys = make_grams(w->traditional, true);
+        if (w->simplified != w->traditional)
+        {
+            const auto& more = make_grams(w->simplified, true);
+            keys.insert(std::end(keys), std::begin(more), std::end(more));
+            std::sort(std::begin(keys), std::end(keys));
+            keys.erase(std::unique(std::begin(keys), std::end(keys)), std::end(keys));
+        }
+        for (const auto key : keys)
+            grams->push_back(gram(key, w));
+    }
+    std::sort(grams->begin(), grams->end());
+    grams_ = std::move(grams);
+    gramsReady_.store(grams_.get(), std::memory_order_release);
+
+    qDebug() << "Built hanzi index with " << grams_->size() << " grams for " << index.size() << " words";
+    return *grams_;
+}
+
+const dictionary::layer::tables& dictionary::layer::lookups() const
+{
+    if (const auto* ready = tablesReady_.load(std::memory_order_acquire))
+        return *ready;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tables_)
+        return *tables_;
+
+    std::unique_ptr<tables> built(new tables);
+    for (const auto& entry : index)
+        link(*built, entry.second);
+    tables_ = std::move(built);
+    tablesReady_.store(tables_.get(), std::memory_order_release);
+
+    qDebug() << "Built lookup tables for " << index.size() << " words";
+    return *tables_;
+}
+
+void dictionary::layer::link(const word* w)
+{
+    // the layer is being modified so no reader has it.
+    if (tables_)
+        link(*tables_, w);
+}
+
+void dictionary::layer::link(tables& tables, const word* w)
+{
+    tables.simplified[w->simplified].push_back(w);
+
+    const auto& initials = make_dictionary_initials(w->key);
+    // a single initial would match a large part of the dictionary
+    if (initials.size() < 2)
+        return;
+
+    // keep the most frequent words first.
+    auto& list = tables.initials[initials];
+    auto pos = std::upper_bound(std::begin(list), std::end(list), w->frequency,
+        [](quint32 frequency, const word* other) {
+            return frequency > other->frequency;
+        });
+    list.insert(pos, w);
+}
+
+void dictionary::layer::unlink(const word* w)
+{
+    if (!tables_)
+        return;
+
+    auto& simplified = tables_->simplified;
+    auto hanzi = simplified.find(w->simplified);
+    if (hanzi != std::end(simplified))
+    {
+        auto& list = hanzi->second;
+        list.erase(std::remove(std::begin(list), std::end(list), w), std::end(list));
+        if (list.empty())
+            simplified.erase(hanzi);
+    }
+
+    auto& initials = tables_->initials;
+    auto it = initials.find(make_dictionary_initials(w->key));
+    if (it == std::end(initials))
+        return;
+
+    auto& list = it->second;
+    list.erase(std::remove(std::begin(list), std::end(list), w), std::end(list));
+    if (list.empty())
+        initials.erase(it);
+}
+
 } // pime
\ No newline at end of file
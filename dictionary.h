@@ -25,46 +25,386 @@
 #include "config.h"
 #include "warnpush.h"
 #  include <QString>
+#  include <QByteArray>
+#  include <QFile>
+#  include <QStringList>
 #include "warnpop.h"
 
 #include <vector>
+#include <deque>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 namespace pime
 {
+    class freqtable;
+    class wordtable;
+
+    // the dictionary contents are versioned. readers get an immutable
+    // snapshot of the words and the indices which they can keep using
+    // from any thread while the dictionary is being modified. each
+    // modification builds a new version from a copy of the current one
+    // and then publishes it atomically. modifications are serialized.
+    //
+    // threading:
+    // - lookup, lookupInitials, lookupSimplified, search, flatten,
+    //   wordCount, generation and current can be called from any number
+    //   of threads at the same time as each other and as the writers.
+    //   they don't wait for a writer to finish its modification. getting
+    //   the current version isn't lock-free though, std::atomic_load of
+    //   a shared_ptr takes a short lock inside the standard library and
+    //   bumps the reference count that all the readers share.
+    //   the first lookup of a layer by initials or hanzi builds its lookup
+    //   tables and the first search its gram index under the layer's
+    //   lock, the other readers of the same layer wait for it. after
+    //   that they're read without taking the lock. a modified layer
+    //   builds its gram index again.
+    //   tools/stress.cpp benchmarks how the reads scale.
+    // - a word pointer stays valid as long as a version that has the
+    //   word is kept around. the words are never changed after they've
+    //   been added and they're freed with the last version that has them.
+    // - description and describe can be called from any thread. they
+    //   share the decoded definition cache behind a short lock.
+    // - load, reload, unload, apply, store and erase can be called from
+    //   any thread and are serialized. the readers see either all or
+    //   none of the changes made by a call. load and reload read the
+    //   file before they take the writer lock.
+    // - setCompact and setLazy must be called before the loading
+    //   starts and not while other threads use the dictionary.
     class dictionary
     {
+        struct image;
     public:
         struct word {
+            enum : quint32 { NoDefinition = 0xffffffff };
+
             QString key;
             QString traditional;
             QString simplified;
             QString pinyin;
+            // the definition of the word, use dictionary::description
+            // to read it since it's empty for the words in compact mode.
             QString description;
+            // the index of the compressed definition or the offset of the
+            // definition in a text dictionary file or NoDefinition.
+            quint32 definition;
+            // nullptr for a compressed definition otherwise the text file.
+            const image* source;
             quint32 meta;
             quint32 guid;
             bool erased;
-            mutable quint32 frequency;
+            // the static frequency of the word, see setFrequencies.
+            quint32 frequency;
+        };
+
+    private:
+        // the data of a dictionary file that the loaded words refer to
+        // directly, either mapped or read into memory. it's kept by the
+        // layers that have the words so it's freed with the last version
+        // that has them. the files are replaced and not written over (see
+        // savefile and the cedict tool) so a mapping keeps the old pages.
+        struct image {
+            std::unique_ptr<QFile> mapping;
+            QByteArray buffer;
+            const char* data;
+            qint64 size;
+
+            bool contains(const void* ptr) const
+            {
+                const auto* p = static_cast<const char*>(ptr);
+                return p >= data && p < data + size;
+            }
+        };
+
+        // the words of one source (metakey) and their indices. a layer
+        // is shared between the versions until its source is modified.
+        struct layer {
+            typedef std::pair<QString, const word*> entry;
+            typedef std::vector<entry>::iterator iterator;
+            // a character bigram or a single character of the hanzi of a word.
+            typedef std::pair<quint32, const word*> gram;
+
+            // the words by their initials and their hanzi. these are
+            // derived from the index on the first lookup and kept up to
+            // date by link and unlink after that.
+            struct tables {
+                // words by the initials of their syllables, most frequent first.
+                std::map<QString, std::vector<const word*>> initials;
+                // words by their simplified hanzi.
+                std::map<QString, std::vector<const word*>> simplified;
+            };
+
+            layer() : words(std::make_shared<std::deque<word>>()), replaced(0),
+                tablesReady_(nullptr), gramsReady_(nullptr)
+            {}
+            // the grams aren't copied, the copy is about to be modified.
+            layer(const layer& other);
+
+            // the words sorted by their keys. the words with equal keys
+            // are kept in the order they were added in.
+            std::vector<entry> index;
+            // the words of the layer. the store is shared with the copies
+            // of the layer and only grows so that the older versions can
+            // keep using the words that have been replaced or erased since.
+            std::shared_ptr<std::deque<word>> words;
+            // the number of words in the store that are no longer indexed.
+            std::size_t replaced;
+            // the file data that the words refer to.
+            std::vector<std::shared_ptr<const image>> images;
+
+            // add a word to the store.
+            word* add(const word& w)
+            {
+                words->push_back(w);
+                return &words->back();
+            }
+
+            // move the indexed words to a new store once the replaced
+            // words outnumber them. the old store is freed with the
+            // last version that uses it.
+            void compact();
+
+            // find the words with the given key.
+            std::pair<iterator, iterator> find(const QString& key);
+
+            // add a single word to the index.
+            void insert(const word* w);
+
+            // sort the words that were appended to the index in bulk.
+            void sort();
+
+            // add or remove a word in the lookup tables if they've been built.
+            void link(const word* w);
+            void unlink(const word* w);
+
+            // get the lookup tables, they're built on the first call.
+            const tables& lookups() const;
+
+            // get the lookup tables if they've been built already.
+            const tables* built() const
+            { return tablesReady_.load(std::memory_order_acquire); }
+
+            // get the grams of all the words sorted by the gram and
+            // then by the word. they're built on the first search.
+            const std::vector<gram>& grams() const;
+
+        private:
+            static void link(tables& tables, const word* w);
+
+        private:
+            mutable std::mutex mutex_;
+            mutable std::unique_ptr<std::vector<gram>> grams_;
+            mutable std::unique_ptr<tables> tables_;
+            // set once grams_ and tables_ are complete so that
+            // the readers don't need to take the lock after that.
+            mutable std::atomic<const tables*> tablesReady_;
+            mutable std::atomic<const std::vector<gram>*> gramsReady_;
+        };
+
+    public:
+        // an immutable version of the dictionary. the words refer to the
+        // compressed definitions kept by the dictionary so a snapshot
+        // must not outlive it. the file data is kept by the snapshot.
+        // the sources are kept in separate layers that are merged at
+        // query time, the words with a lower metakey come first.
+        class snapshot
+        {
+        public:
+            // lookup a list of words with the given key in the dictionary.
+            std::vector<const word*> lookup(const QString& key) const;
+
+            // lookup a list of words whose syllables start with the given
+            // initials, e.g. "zg" for zhongguo. the most frequent words come first.
+            std::vector<const word*> lookupInitials(const QString& initials) const;
+
+            // lookup the words that are written with the given simplified hanzi.
+            std::vector<const word*> lookupSimplified(const QString& hanzi) const;
+
+            // search the definitions of the word for the given substring
+            // and return those that match. a string of Chinese characters
+            // is found in the hanzi of the words using the character n-gram
+            // index and only the definitions of the rest are searched.
+            std::vector<const word*> search(const QString& str) const;
+
+            // flatten the whole dictionary into a list.
+            std::vector<const word*> flatten() const;
+
+            // save the words with the given metakey to a file
+            void save(const QString& file, quint32 metakey) const;
+
+            // save the words with the given metakey to a compiled dictionary file.
+            void compile(const QString& file, quint32 metakey) const;
+
+            // return the number of words in the dictionary.
+            std::size_t wordCount() const;
+
+            // return the generation of the dictionary contents.
+            // each new version has a new generation.
+            quint32 generation() const
+            { return generation_; }
+
+            // return the generation in which the words with the
+            // given metakey were last modified.
+            quint32 modified(quint32 metakey) const
+            {
+                const auto it = modified_.find(metakey);
+                if (it == std::end(modified_))
+                    return 0;
+                return it->second;
+            }
+
+        private:
+            friend class dictionary;
+            typedef std::vector<layer::entry>::const_iterator iterator;
+            typedef std::pair<iterator, iterator> range;
+
+            // get the layer for modifying in this version.
+            layer& edit(quint32 metakey);
+            std::vector<const word*> select(quint32 metakey) const;
+            // find the words whose hanzi contain the string, in no particular order.
+            std::vector<const word*> searchHanzi(const QString& str) const;
+            // merge the ranges in the key order and append the words to the list.
+            static void merge(std::vector<range>& ranges, std::vector<const word*>& words);
+
+        private:
+            const dictionary* owner_;
+            quint32 generation_;
+            std::map<quint32, std::shared_ptr<layer>> layers_;
+            std::map<quint32, quint32> modified_;
+        };
+
+        typedef std::shared_ptr<const snapshot> version;
+
+        // a breakdown of the memory used by the dictionary in bytes.
+        struct memory {
+            // the records of the words in the current version.
+            quint64 records;
+            // the strings owned by the words in the current version.
+            quint64 strings;
+            // the nodes of the indices.
+            quint64 index;
+            // the records that are no longer in the current version
+            // but are kept around for older snapshots.
+            quint64 tombstones;
+            // the compressed definitions and the dictionary images
+            // that have been read into memory.
+            quint64 definitions;
+            // the mapped dictionary files. these are shared with
+            // the other processes through the page cache.
+            quint64 mapped;
+            // the records and strings per metakey.
+            std::map<quint32, quint64> metas;
+
+            // the private memory of the dictionary.
+            quint64 total() const
+            { return records + strings + index + tombstones + definitions; }
         };
 
         dictionary();
        ~dictionary();
 
-        // load a dictionary file
+        // get the current version of the dictionary.
+        version current() const;
+
+        // in compact mode the dictionary files that are loaded afterwards
+        // keep their definitions compressed in blocks which are decoded
+        // on demand, and the strings that repeat are stored only once.
+        // this has no effect on the compiled dictionaries which are
+        // mapped directly from the disk.
+        void setCompact(bool on_off)
+        { compact_ = on_off; }
+
+        // in lazy mode the text dictionary files that are loaded afterwards
+        // are kept in memory as they are and the definitions are only
+        // decoded when they're needed. only the keys, hanzi and pinyin
+        // are kept as strings. the files are read and not mapped so that
+        // changing a file while it's used doesn't pull the data from
+        // under the words.
+        void setLazy(bool on_off)
+        { lazy_ = on_off; }
+
+        // set the tables that give the frequency of the words that are
+        // loaded or stored afterwards. the single characters are looked
+        // up from the character table and the longer words from the word
+        // table. the tables must outlive the dictionary and not change
+        // once set. the words of a compiled dictionary keep their compiled
+        // frequency when it was compiled with the same tables (see dicfile.h)
+        // or when there are no tables. without the tables the rest are 0.
+        void setFrequencies(const freqtable* chars, const wordtable* words)
+        {
+            charfreq_ = chars;
+            wordfreq_ = words;
+        }
+
+        // get the definition of the word.
+        QString description(const word& w) const;
+
+        // get the definitions of the words.
+        std::vector<QString> describe(const std::vector<const word*>& words) const;
+
+        // compute the memory used by the dictionary. this walks over all
+        // the words of the current version and is meant for diagnostics,
+        // it's too slow to be called after every change.
+        memory memoryUsage() const;
+
+        // load a dictionary file. the file can be either a text
+        // dictionary or a compiled dictionary (see dicfile.h)
+        // a compiled dictionary is mapped so that its strings are shared
+        // with the other processes but each word still costs a record,
+        // the string headers and the index entries in every process,
+        // roughly 300 bytes per word. the mapping is released with the
+        // last version that has the words. on windows the files are read
+        // instead of mapped so that they can be saved over.
         void load(const QString& file, quint32 metakey);
 
+        // load the dictionary file again replacing the words with
+        // the given metakey. only the index of the metakey is rebuilt.
+        // the file is parsed before taking the writer lock so this can
+        // be called from a background thread without blocking the readers
+        // or the other writers for longer than it takes to swap the words.
+        // throws if the words with the metakey were modified while the
+        // file was being read. returns the generation that has the new contents.
+        quint32 reload(const QString& file, quint32 metakey);
+
         // save the in memory contents of the dictionary to a file
-        void save(const QString& file, quint32 metakey);
+        void save(const QString& file, quint32 metakey)
+        { current()->save(file, metakey); }
+
+        // save the in memory contents of the dictionary to a
+        // compiled dictionary file.
+        void compile(const QString& file, quint32 metakey)
+        { current()->compile(file, metakey); }
+
+        // remove the words with the given metakey.
+        void unload(quint32 metakey);
+
+        // apply a delta file produced by the cedict tool (cedict -d) to the
+        // words with the given metakey. words are matched by their traditional,
+        // simplified and pinyin and only the index entries of the changed
+        // words are touched. applying the same delta again has no effect.
+        // the file is read before taking the writer lock.
+        // returns the number of words that were added, removed or changed.
+        std::size_t apply(const QString& file, quint32 metakey);
 
         // lookup a list of words with the given key in the dictionary.
-        std::vector<const word*> lookup(const QString& key) const;
+        std::vector<const word*> lookup(const QString& key) const
+        { return current()->lookup(key); }
+
+        // lookup a list of words whose syllables start with the given initials.
+        std::vector<const word*> lookupInitials(const QString& initials) const
+        { return current()->lookupInitials(initials); }
 
         // search the definitions of the word for the given substring
         // and return those that match.
-        std::vector<const word*> search(const QString& str) const;
+        std::vector<const word*> search(const QString& str) const
+        { return current()->search(str); }
 
         // flatten the whole dictionary into a list.
-        std::vector<const word*> flatten() const;
+        std::vector<const word*> flatten() const
+        { return current()->flatten(); }
 
         // store a word in the dictionary.
         // if the word indentified by the given key and guid already exists
@@ -76,13 +416,49 @@ namespace pime
 
         // return the number of words in the dictionary.
         std::size_t wordCount() const 
-        { return words_.size(); }
+        { return current()->wordCount(); }
+
+        // return the current generation of the dictionary contents.
+        // the generation changes whenever words are added, modified or
+        // removed, i.e. whenever previously returned words may have been
+        // invalidated.
+        quint32 generation() const
+        { return current()->generation(); }
     private:
-        quint32 wordguid_;
+        // read the words of the file into a new layer. this doesn't
+        // need the writer lock.
+        void read(layer& layer, const QString& file, quint32 metakey);
+        void parse(layer& layer, QFile& io, const QString& file, quint32 metakey);
+        void loadCompiled(layer& layer, const QString& file, std::shared_ptr<image> image, quint32 metakey);
+        void loadLazy(layer& layer, const QString& file, std::shared_ptr<image> text, quint32 metakey);
+        void define(word& w, const QString& desc);
+        quint32 frequency(const word& w) const;
+
+        // make a new version from a copy of the current version.
+        std::shared_ptr<snapshot> copy() const;
+        void publish(std::shared_ptr<snapshot> next);
 
     private:
-        std::multimap<QString, std::size_t> index_;
-        std::vector<word> words_;
+        enum : quint32 { BLOCK_SIZE = 64 };
+        enum : std::size_t { CACHE_SIZE = 8 };
 
+    private:
+        std::atomic<quint32> wordguid_;
+        bool compact_;
+        bool lazy_;
+        const freqtable* charfreq_;
+        const wordtable* wordfreq_;
+        // serialize the modifications.
+        mutable std::mutex mutex_;
+        std::shared_ptr<const snapshot> current_;
+
+
+    private:
+        // the compressed definitions of the words in compact mode.
+        // the last block that's still being filled is kept uncompressed.
+        mutable std::mutex defmutex_;
+        std::vector<QByteArray> blocks_;
+        QStringList pending_;
+        mutable std::list<std::pair<quint32, QStringList>> cache_;
     };
 } // pime
\ No newline at end of file
@@ -51,7 +51,7 @@ public:
                 case 0: return word.traditional;
                 case 1: return word.simplified;
                 case 2: return word.pinyin;
-                case 3: return word.description;
+                case 3: return dic_.description(word);
             }
         }
         else if (role == Qt::FontRole)
@@ -86,9 +86,10 @@ public:
 
     void filter(const QString& str)
     {
+        version_ = dic_.current();
         if (str.isEmpty())
-             words_ = dic_.flatten();
-        else words_ = dic_.search(str);
+             words_ = version_->flatten();
+        else words_ = version_->search(str);
 
         reset();
 
@@ -105,9 +106,10 @@ public:
     {
         if (dic_.store(w))
         {
+            version_ = dic_.current();
             if (search_.isEmpty())
-                words_ = dic_.flatten();
-            else words_ = dic_.lookup(search_);
+                words_ = version_->flatten();
+            else words_ = version_->lookup(search_);
 
             const auto first = index(0, 0);
             const auto last  = index((int)words_.size(), 3);
@@ -115,9 +117,10 @@ public:
         }
         else
         {
+            version_ = dic_.current();
             if (search_.isEmpty())
-                words_ = dic_.flatten();
-            else words_ = dic_.lookup(search_);
+                words_ = version_->flatten();
+            else words_ = version_->lookup(search_);
             
             reset();
         }
@@ -146,6 +149,12 @@ public:
         return *words_[i];
     }
 
+    QString getDescription(std::size_t i)
+    {
+        Q_ASSERT(i < words_.size());
+        return dic_.description(*words_[i]);
+    }
+
     void setChFont(QFont font)
     {
         font_ = font;
@@ -154,6 +163,8 @@ public:
     { return font_; }
 private:
     dictionary& dic_;
+    // the version that the words come from.
+    dictionary::version version_;
     std::vector<const dictionary::word*> words_;
 private:
     QString search_;
@@ -223,6 +234,7 @@ void DlgDictionary::on_btnAdd_clicked()
     word.traditional = dlg.traditional();
     word.simplified  = dlg.simplified();
     word.description = dlg.desc();
+    word.definition  = dictionary::word::NoDefinition;
     word.pinyin      = dlg.pinyin();
     word.meta        = 1;
     word.erased      = false;
@@ -260,7 +272,7 @@ void DlgDictionary::on_btnEdit_clicked()
             word.pinyin,
             word.traditional,
             word.simplified,
-            word.description);
+            model_->getDescription(row));
         if (dlg.exec() == QDialog::Rejected)
             continue;
 
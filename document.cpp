@@ -0,0 +1,260 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QtDebug>
+#include "warnpop.h"
+#include <algorithm>
+
+#include "document.h"
+
+namespace pime
+{
+
+document::document() : size_(0), cursor_(0)
+{
+    clear();
+}
+
+document::~document()
+{}
+
+void document::insert(const word& w)
+{
+    std::size_t local = 0;
+    const auto at = locate(cursor_, local);
+
+    words_.push_back(w);
+    const auto& text = words_.back();
+    const auto index = words_.size() - 1;
+    const auto& sum  = sums_.back();
+    lengths next;
+    next.traditional = sum.traditional + hanzi(text, false).size();
+    next.simplified  = sum.simplified + hanzi(text, true).size();
+    next.pinyin      = sum.pinyin + pinyin(text).size();
+    sums_.push_back(next);
+
+    const auto added = make_piece(index, 1);
+    total_.traditional += added.traditional;
+    total_.simplified  += added.simplified;
+    total_.pinyin      += added.pinyin;
+    ++size_;
+    ++cursor_;
+
+    // typing at the end of the previous word just extends its piece.
+    if (local == 0 && at > 0)
+    {
+        auto& prev = pieces_[at-1];
+        if (prev.start + prev.count == index)
+        {
+            prev = make_piece(prev.start, prev.count + 1);
+            return;
+        }
+    }
+
+    if (local == 0)
+    {
+        pieces_.insert(pieces_.begin() + at, added);
+        return;
+    }
+
+    // split the piece in two and put the new word in between.
+    const auto old  = pieces_[at];
+    const auto head = make_piece(old.start, local);
+    const auto tail = make_piece(old.start + local, old.count - local);
+    pieces_[at] = head;
+    pieces_.insert(pieces_.begin() + at + 1, added);
+    pieces_.insert(pieces_.begin() + at + 2, tail);
+}
+
+void document::erase(std::size_t pos)
+{
+    Q_ASSERT(pos < size_);
+
+    std::size_t local = 0;
+    const auto at  = locate(pos, local);
+    const auto old = pieces_[at];
+
+    const auto index = old.start + local;
+    const auto head  = make_piece(old.start, local);
+    const auto gone  = make_piece(index, 1);
+    const auto tail  = make_piece(index + 1, old.count - local - 1);
+    total_.traditional -= gone.traditional;
+    total_.simplified  -= gone.simplified;
+    total_.pinyin      -= gone.pinyin;
+
+    pieces_.erase(pieces_.begin() + at);
+    if (tail.count)
+        pieces_.insert(pieces_.begin() + at, tail);
+    if (head.count)
+        pieces_.insert(pieces_.begin() + at, head);
+
+    // the last word typed is given back to the buffer so that
+    // typing it again extends the piece before it.
+    if (index + 1 == words_.size())
+    {
+        words_.pop_back();
+        sums_.pop_back();
+    }
+
+    --size_;
+    if (cursor_ > pos)
+        --cursor_;
+}
+
+void document::clear()
+{
+    words_.clear();
+    pieces_.clear();
+    sums_.clear();
+    sums_.push_back(lengths());
+    sums_.back().traditional = 0;
+    sums_.back().simplified  = 0;
+    sums_.back().pinyin      = 0;
+    total_  = sums_.back();
+    size_   = 0;
+    cursor_ = 0;
+}
+
+const document::word& document::at(std::size_t pos) const
+{
+    Q_ASSERT(pos < size_);
+
+    std::size_t local = 0;
+    const auto& p = pieces_[locate(pos, local)];
+    return words_[p.start + local];
+}
+
+void document::setCursor(std::size_t pos)
+{
+    cursor_ = std::min(pos, size_);
+}
+
+int document::hanziOffset(std::size_t pos, bool simplified) const
+{
+    if (simplified)
+        return offset(pos, [](const lengths& p) { return p.simplified; });
+    return offset(pos, [](const lengths& p) { return p.traditional; });
+}
+
+int document::pinyinOffset(std::size_t pos) const
+{
+    return offset(pos, [](const lengths& p) { return p.pinyin; });
+}
+
+QString document::hanziText(bool simplified) const
+{
+    QString ret;
+    ret.reserve(hanziOffset(size_, simplified));
+    for (const auto& p : pieces_)
+    {
+        for (std::size_t i=0; i<p.count; ++i)
+            ret.append(hanzi(words_[p.start + i], simplified));
+    }
+    return ret;
+}
+
+QString document::pinyinText() const
+{
+    QString ret;
+    ret.reserve(pinyinOffset(size_));
+    for (const auto& p : pieces_)
+    {
+        for (std::size_t i=0; i<p.count; ++i)
+            ret.append(pinyin(words_[p.start + i]));
+    }
+    return ret;
+}
+
+document::piece document::make_piece(std::size_t start, std::size_t count) const
+{
+    const auto& beg = sums_[start];
+    const auto& end = sums_[start + count];
+    piece p;
+    p.start       = start;
+    p.count       = count;
+    p.traditional = end.traditional - beg.traditional;
+    p.simplified  = end.simplified - beg.simplified;
+    p.pinyin      = end.pinyin - beg.pinyin;
+    return p;
+}
+
+std::size_t document::locate(std::size_t pos, std::size_t& local) const
+{
+    local = 0;
+    if (pos == size_)
+        return pieces_.size();
+
+    // the pieces are few compared to the words since the
+    // words are mostly added at the end. the positions near
+    // the end are found by walking back from it.
+    if (pos >= size_ / 2)
+    {
+        std::size_t end = size_;
+        std::size_t i = pieces_.size();
+        while (end - pieces_[i-1].count > pos)
+            end -= pieces_[--i].count;
+        --i;
+        local = pos - (end - pieces_[i].count);
+        return i;
+    }
+
+    std::size_t i = 0;
+    for (; i<pieces_.size(); ++i)
+    {
+        if (pos < pieces_[i].count)
+            break;
+        pos -= pieces_[i].count;
+    }
+    local = pos;
+    return i;
+}
+
+template<typename F>
+int document::offset(std::size_t pos, F length) const
+{
+    std::size_t local = 0;
+    const auto at = locate(pos, local);
+    if (at == pieces_.size())
+        return length(total_);
+
+    const auto& p = pieces_[at];
+    const auto head = make_piece(p.start, local);
+
+    // count from the nearer end of the text.
+    if (at >= pieces_.size() / 2)
+    {
+        int ret = length(total_) - length(p) + length(head);
+        for (std::size_t i=at+1; i<pieces_.size(); ++i)
+            ret -= length(pieces_[i]);
+        return ret;
+    }
+
+    int ret = length(head);
+    for (std::size_t i=0; i<at; ++i)
+        ret += length(pieces_[i]);
+    return ret;
+}
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,125 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#include "warnpop.h"
+#include <vector>
+#include <cstddef>
+
+namespace pime
+{
+    // the translated text as a sequence of words. the words are kept in
+    // a piece table: every word ever added is appended to a buffer that
+    // is never modified and the document is a list of pieces (spans)
+    // of that buffer. appending to the end extends the last piece and
+    // inserting or erasing in the middle only splits a piece, so the
+    // words are never copied around when the text is edited.
+    // the text lengths of the buffer are kept as prefix sums so that
+    // the length of any span of it is found in constant time.
+    class document
+    {
+    public:
+        struct word {
+            QString key;
+            QString pinyin;
+            QString traditional;
+            QString simplified;
+        };
+
+        document();
+       ~document();
+
+        // insert a word at the cursor and move the cursor after it.
+        void insert(const word& w);
+
+        // erase the word at the given position. a cursor after
+        // the word moves back by one.
+        void erase(std::size_t pos);
+
+        // remove all the words.
+        void clear();
+
+        // get the word at the given position.
+        const word& at(std::size_t pos) const;
+
+        // the position (in words) where the next word is inserted.
+        std::size_t cursor() const
+        { return cursor_; }
+
+        void setCursor(std::size_t pos);
+
+        std::size_t size() const
+        { return size_; }
+
+        bool empty() const
+        { return size_ == 0; }
+
+        // the offset of the word at the given position in the chinese
+        // text or in the pinyin text. pos can be size() for the end.
+        int hanziOffset(std::size_t pos, bool simplified) const;
+        int pinyinOffset(std::size_t pos) const;
+
+        // the text of the word as it appears in the chinese or pinyin text.
+        static QString hanzi(const word& w, bool simplified)
+        { return simplified ? w.simplified : w.traditional; }
+        static QString pinyin(const word& w)
+        { return w.pinyin + " "; }
+
+        // render the whole chinese or pinyin text.
+        QString hanziText(bool simplified) const;
+        QString pinyinText() const;
+    private:
+        struct lengths {
+            int traditional;
+            int simplified;
+            int pinyin;
+        };
+        struct piece : lengths {
+            std::size_t start;
+            std::size_t count;
+        };
+        piece make_piece(std::size_t start, std::size_t count) const;
+
+        // find the piece that holds the word at pos and
+        // the position of the word within the piece.
+        std::size_t locate(std::size_t pos, std::size_t& local) const;
+
+        template<typename F>
+        int offset(std::size_t pos, F length) const;
+
+    private:
+        std::vector<word> words_;
+        // sums_[i] is the length of the words before words_[i].
+        std::vector<lengths> sums_;
+        std::vector<piece> pieces_;
+        // the length of the whole text.
+        lengths total_;
+        std::size_t size_;
+        std::size_t cursor_;
+    };
+
+} // pime
\ No newline at end of file
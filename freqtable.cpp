@@ -24,13 +24,14 @@
 #include "warnpush.h"
 #  include <QFile>
 #  include <QIODevice>
-#  include <QTextStream>
-#  include <QStringList>
 #include "warnpop.h"
 #include <stdexcept>
 
 #include "freqtable.h"
+#include "textfile.h"
 #include "format.h"
+#include "memusage.h"
+#include "dicfile.h"
 
 // frequency table data from 
 // http://lingua.mtsu.edu/chinese-computing/statistics/char/list.php?Which=MO
@@ -41,7 +42,7 @@
 namespace pime
 {
 
-freqtable::freqtable()
+freqtable::freqtable() : checksum_(0)
 {}
 
 freqtable::~freqtable()
@@ -49,23 +50,31 @@ freqtable::~freqtable()
 
 void freqtable::load(const QString& file)
 {
-    QFile io(file);
-    if (!io.open(QIODevice::ReadOnly))
-        throw std::runtime_error(utf8("open frequence table failed: _1", file));
-
-    QTextStream stream(&io);
-    stream.setCodec("UTF-8");
-    while (!stream.atEnd())
+    textfile text(file);
+    while (text.next())
     {
-        const auto& line  = stream.readLine();
-        const auto& words = line.split("\t");
-        if (words.size() != 2)
-            throw std::runtime_error("unexpected frequency table data");
+        textfile::field toks[2];
+        if (text.fields('\t') != 2 || !text.split('\t', toks, 2))
+            throw text.error("unexpected frequency table data");
+
+        bool ok = false;
+        const auto freq = toks[1].toLongLong(&ok);
+        if (!ok)
+            throw text.error("unexpected frequency table data");
 
-        const auto& word = words[0];
-        const auto& freq = words[1].toLongLong();
-        table_[word] = freq;
+        table_[toks[0].toString()] = freq;
     }
+    checksum_ = dicfile::checksum(text.data(), text.size(), checksum_);
+}
+
+freqtable::memory freqtable::memoryUsage() const
+{
+    memory mem;
+    mem.index   = table_.size() * node_bytes(table_);
+    mem.strings = 0;
+    for (const auto& pair : table_)
+        mem.strings += string_bytes(pair.first);
+    return mem;
 }
 
 } // pime
@@ -31,6 +31,8 @@
 
 namespace pime
 {
+    // character frequencies. the table isn't changed after loading
+    // so the const members can be called from several threads.
     class freqtable
     {
     public:
@@ -39,7 +41,7 @@ namespace pime
 
         void load(const QString& file);
 
-        quint32 lookup(const QString& word)
+        quint32 lookup(const QString& word) const
         {
             const auto it = table_.find(word);
             if (it == std::end(table_))
@@ -50,8 +52,27 @@ namespace pime
 
         std::size_t freqCount() const 
         { return table_.size(); }
+
+        // the checksum of the loaded files (see dicfile::checksum)
+        // or 0 if nothing has been loaded.
+        quint32 checksum() const
+        { return checksum_; }
+
+        // a breakdown of the memory used by the table in bytes.
+        struct memory {
+            // the nodes of the table.
+            quint64 index;
+            // the strings of the words.
+            quint64 strings;
+
+            quint64 total() const
+            { return index + strings; }
+        };
+
+        memory memoryUsage() const;
     private:
         std::map<QString, quint32> table_;
+        quint32 checksum_;
     };
 
 } // pime
\ No newline at end of file
@@ -29,24 +29,82 @@
 #include <iostream>
 
 #include "mainwindow.h"
+#include "tracer.h"
 
 int main(int argc, char* argv[])
 {
     QApplication app(argc, argv);
 
+    // write a trace of the startup phases if requested with
+    // --trace file or with PIME_TRACE=file in the environment.
+    const auto& args = app.arguments();
+    const auto trace = args.indexOf("--trace");
+    if (trace != -1 && trace + 1 < args.size())
+        pime::tracer::enable(args[trace + 1]);
+    else if (!qgetenv("PIME_TRACE").isEmpty())
+        pime::tracer::enable(QString::fromLocal8Bit(qgetenv("PIME_TRACE").constData()));
+
     // have to create a window so that if there's an error and we're
     // trying to show the error message box we have  parent window
     // where to place the message. otherwise the user has no context
     // where the message popped up. (i think it makes more sense this way)
     pime::MainWindow window;
+
+    // the command line modes print the result and exit. there's
+    // no one to see a message box so the errors go to the stderr.
+    try
+    {
+        // print the memory used by the data and exit.
+        if (args.contains("--memory"))
+        {
+            window.loadData();
+            std::cout << window.memoryReport().toUtf8().constData();
+            pime::tracer::finish();
+            return 0;
+        }
+
+        // convert a Chinese text file and exit.
+        // --pinyin|--simplified|--traditional input [output]
+        const std::pair<const char*, pime::MainWindow::conversion> conversions[] = {
+            {"--pinyin",      pime::MainWindow::conversion::pinyin},
+            {"--simplified",  pime::MainWindow::conversion::simplified},
+            {"--traditional", pime::MainWindow::conversion::traditional}
+        };
+        for (const auto& conversion : conversions)
+        {
+            const auto arg = args.indexOf(conversion.first);
+            if (arg == -1 || arg + 1 >= args.size())
+                continue;
+
+            // the output is optional so the next option isn't it.
+            QString out;
+            if (arg + 2 < args.size() && !args[arg + 2].startsWith("--"))
+                out = args[arg + 2];
+
+            window.loadData();
+            window.convert(conversion.second, args[arg + 1], out);
+            pime::tracer::finish();
+            return 0;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        pime::tracer::finish();
+        return 1;
+    }
+
     try
     {
         window.show();
         window.loadData();        
+        pime::tracer::finish();
         return app.exec();
     }
     catch (const std::exception& e) 
     {
+        pime::tracer::finish();
+
         QMessageBox msg(&window);
         msg.setIcon(QMessageBox::Critical);
         msg.setText(QString::fromUtf8(e.what()));
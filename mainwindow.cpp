@@ -28,15 +28,27 @@
 #  include <QtGui/QStyleFactory>
 #  include <QtGui/QMessageBox>
 #  include <QtGui/QFontDialog>
+#  include <QtGui/QToolTip>
+#  include <QtGui/QHelpEvent>
+#  include <QtGui/QTextDocument>
 #  include <QtDebug>
 #  include <QDir>
 #  include <QFileInfo>
+#  include <QFile>
 #  include <QSettings>
+#  include <QTextStream>
+#  include <QtConcurrentRun>
 #include "warnpop.h"
 #include <stdexcept>
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <list>
 
 #include "mainwindow.h"
+#include "tracer.h"
+#include "savefile.h"
+#include "format.h"
 #include "pinyin.h"
 #include "dlgword.h"
 #include "dlgdictionary.h"
@@ -44,13 +56,39 @@
 #define NOTE(x) \
     ui_.statusbar->showMessage(x, 5000)
 
+namespace {
+    // how often to save the modified data (in milliseconds)
+    const int AUTOSAVE_INTERVAL = 60 * 1000;
+    // how long to wait for the changes to a dictionary
+    // file to settle before loading it again (in milliseconds)
+    const int RELOAD_DELAY = 1000;
+
+    // rename an applied delta file so that it's not applied again.
+    void retire_delta(const QString& file)
+    {
+        QFile::remove(file + ".applied");
+        QFile::rename(file, file + ".applied");
+    }
+
+    // hash the contents of the file. the file times have only
+    // a second's resolution so they can't tell all changes apart.
+    uint hash_file(const QString& file)
+    {
+        QFile io(file);
+        if (!io.open(QIODevice::ReadOnly))
+            return 0;
+        return qHash(io.readAll());
+    }
+} // namespace
+
 namespace pime
 {
 
 class MainWindow::DicModel : public QAbstractTableModel
 {
 public:
-    DicModel(dictionary& dic, freqtable& freq) : dic_(dic), freq_(freq), traditional_(true)
+    DicModel(dictionary& dic, const wordtable& words, usagetable& usage) 
+        : dic_(dic), wordfreq_(words), usage_(usage), traditional_(true)
     {}
 
     virtual QVariant data(const QModelIndex& index, int role) const override
@@ -72,7 +110,7 @@ public:
                     else return word.simplified;
 
                 case 2: return word.pinyin;
-                case 3: return word.description;
+                case 3: return dic_.description(word);
             }            
         }
         else if (role == Qt::FontRole)
@@ -115,27 +153,90 @@ public:
     {
         dic_.store(word);
     }
-    void update(const QString& key)
+    // list the words for the key. the previous word of the text
+    // lifts the words that usually follow it.
+    void update(const QString& key, const QString& previous = QString())
     {
-        words_ = dic_.lookup(key);
+        refresh();
+
+        key_   = key;
+        words_ = version_->lookup(key);
+
+        // the words that match the key exactly come first,
+        // these are the candidates that get ranked.
         auto it = std::begin(words_);
         for (; it != std::end(words_); ++it)
         {
-            auto* w = *it;
-            if (w->key != key)
+            if ((*it)->key != key)
                 break;
+        }
 
-            w->frequency = freq_.lookup(w->simplified);
+        // nothing starts with the key so it might be an abbreviation.
+        // all the words with the same initials are candidates.
+        if (words_.empty() && key.size() > 1)
+        {
+            words_ = version_->lookupInitials(key);
+            it = std::end(words_);
         }
 
-        std::sort(std::begin(words_), it, 
-            [](const dictionary::word* lhs, const dictionary::word* rhs)
-            {
-                return rhs->frequency < lhs->frequency;
-            });
+        if (it != std::begin(words_))
+        {
+            const auto& ranked = rank(key, std::begin(words_), it);
+            for (std::size_t i=0; i<ranked.size(); ++i)
+                words_[i] = ranked[i].word;
+            follow(previous, std::begin(words_), it);
+        }
 
         reset();
     }
+
+    // show the words that are likely to follow the previous word.
+    // if nothing is known about the previous word then the whole
+    // dictionary is listed as before.
+    void predict(const QString& previous)
+    {
+        const std::size_t MAX_PREDICTIONS = 100;
+
+        refresh();
+
+        key_.clear();
+        words_.clear();
+
+        const auto id = wordfreq_.find(previous);
+        const auto& next = wordfreq_.successors(id);
+        if (next.first != next.second)
+        {
+            for (auto it = next.first; it != next.second; ++it)
+            {
+                const auto& words = version_->lookupSimplified(wordfreq_.word(*it));
+                words_.insert(std::end(words_), std::begin(words), std::end(words));
+                if (words_.size() >= MAX_PREDICTIONS)
+                    break;
+            }
+        }
+        if (words_.empty())
+        {
+            update("");
+            return;
+        }
+        reset();
+    }
+
+    // the user selected the word at the given index for translation.
+    // record the selection and move the word to its new place in the ranking.
+    void select(std::size_t index)
+    {
+        const auto* word  = words_[index];
+        const auto  count = usage_.record(*word);
+        const auto  value = score(*word, count);
+
+        // the word moves up in the ranking of the key it was picked
+        // with, which can be an abbreviation, and in that of its own key.
+        promote(key_, word, value);
+        if (key_ != word->key)
+            promote(word->key, word, value);
+    }
+
     const dictionary::word& getWord(std::size_t i) const 
     {
         return *words_[i];
@@ -157,14 +258,152 @@ public:
         emit dataChanged(first, last);
     }
 private:
+    struct candidate {
+        double score;
+        const dictionary::word* word;
+    };
+
+    // blend the static frequency with the number of times the user
+    // has picked the word. a couple of selections are enough to lift
+    // a rare word above the common ones with the same key.
+    double score(const dictionary::word& word, quint32 usage) const
+    {
+        const double USAGE_WEIGHT = 2.0;
+        return std::log(1.0 + word.frequency) + USAGE_WEIGHT * usage;
+    }
+
+    // move the ranked words that have been seen after the previous
+    // word to the front, the most common pair first. the rest keep
+    // their ranking. only the candidates are looked at so this is
+    // cheap enough to do on every key press.
+    template<typename It>
+    void follow(const QString& previous, It beg, It end)
+    {
+        if (previous.isEmpty())
+            return;
+        const auto& next = wordfreq_.successors(wordfreq_.find(previous));
+        if (next.first == next.second)
+            return;
+
+        std::vector<std::pair<quint32, const dictionary::word*>> likely;
+        std::vector<const dictionary::word*> rest;
+        for (auto it = beg; it != end; ++it)
+        {
+            const auto count = wordfreq_.bigram(previous, (*it)->simplified);
+            if (count)
+                likely.push_back(std::make_pair(count, *it));
+            else rest.push_back(*it);
+        }
+        if (likely.empty())
+            return;
+
+        std::stable_sort(std::begin(likely), std::end(likely),
+            [](const std::pair<quint32, const dictionary::word*>& lhs,
+               const std::pair<quint32, const dictionary::word*>& rhs) {
+                return lhs.first > rhs.first;
+            });
+        for (const auto& l : likely)
+            *beg++ = l.second;
+        std::copy(std::begin(rest), std::end(rest), beg);
+    }
+
+    // take the current version of the dictionary if the words have
+    // changed. the cached rankings are then stale.
+    void refresh()
+    {
+        auto current = dic_.current();
+        if (version_ && version_->generation() == current->generation())
+            return;
+        ranking_.clear();
+        version_ = std::move(current);
+    }
+
+    // move the word to its new place in the ranking of the key.
+    void promote(const QString& key, const dictionary::word* word, double value)
+    {
+        auto it = std::find_if(std::begin(ranking_), std::end(ranking_),
+            [&](const ranking& r) {
+                return r.first == key;
+            });
+        if (it == std::end(ranking_))
+            return;
+
+        // there's only a handful of candidates per key so a linear
+        // search and a rotate are cheaper than keeping a tree.
+        auto& list = it->second;
+        auto pos = std::find_if(std::begin(list), std::end(list),
+            [=](const candidate& c) {
+                return c.word == word;
+            });
+        if (pos == std::end(list))
+            return;
+
+        // the score only ever goes up so the word can only move
+        // towards the front and the rest of the list stays sorted.
+        pos->score = value;
+        auto place = std::upper_bound(std::begin(list), pos, *pos, 
+            [](const candidate& lhs, const candidate& rhs) {
+                return lhs.score > rhs.score;
+            });
+        std::rotate(place, pos, pos + 1);
+    }
+
+    // get the ranked candidates for the key. the ranking is computed
+    // once per key and then kept up to date by select() so that it
+    // doesn't need to be sorted again on every key press. only the
+    // rankings of the last MAX_RANKINGS keys are kept.
+    template<typename It>
+    const std::vector<candidate>& rank(const QString& key, It beg, It end)
+    {
+        // keep the rankings of the most recently used keys.
+        auto it = std::find_if(std::begin(ranking_), std::end(ranking_),
+            [&](const ranking& r) {
+                return r.first == key;
+            });
+        if (it != std::end(ranking_))
+        {
+            if (it != std::begin(ranking_))
+                ranking_.splice(std::begin(ranking_), ranking_, it);
+            return ranking_.front().second;
+        }
+
+        std::vector<candidate> list;
+        for (; beg != end; ++beg)
+        {
+            candidate c;
+            c.word  = *beg;
+            c.score = score(*c.word, usage_.lookup(*c.word));
+            list.push_back(c);
+        }
+        std::stable_sort(std::begin(list), std::end(list),
+            [](const candidate& lhs, const candidate& rhs) {
+                return lhs.score > rhs.score;
+            });
+        ranking_.push_front(std::make_pair(key, std::move(list)));
+        if (ranking_.size() > MAX_RANKINGS)
+            ranking_.pop_back();
+        return ranking_.front().second;
+    }
+
+private:
+    enum : std::size_t { MAX_RANKINGS = 64 };
+    typedef std::pair<QString, std::vector<candidate>> ranking;
+
+    // the version that the words come from. it's kept so that
+    // the words stay valid until the model is updated again.
+    dictionary::version version_;
     std::vector<const dictionary::word*> words_;
+    // the key that the words were looked up with.
+    QString key_;
+    std::list<ranking> ranking_;
     dictionary& dic_;
-    freqtable& freq_;
+    const wordtable& wordfreq_;
+    usagetable& usage_;
     bool traditional_;
     QFont chfont_;
 };
 
-MainWindow::MainWindow() : model_(new DicModel(dic_, freq_))
+MainWindow::MainWindow() : model_(new DicModel(dic_, words_, usage_)), usageSaved_(0), pinyinGeneration_(0), scriptGeneration_(0)
 {
     ui_.setupUi(this);
     ui_.tableView->setModel(model_.get());
@@ -187,6 +426,12 @@ MainWindow::MainWindow() : model_(new DicModel(dic_, freq_))
     ui_.actionTraditional->setChecked(traditional);
     ui_.actionSimplified->setChecked(!traditional);
     ui_.editInput->installEventFilter(this);    
+    ui_.lblInfoText->installEventFilter(this);
+    // the translation is edited word by word through the input.
+    ui_.editChinese->setReadOnly(true);
+    ui_.editPinyin->setReadOnly(true);
+    ui_.editChinese->setMaxLength(std::numeric_limits<int>::max());
+    ui_.editPinyin->setMaxLength(std::numeric_limits<int>::max());
     model_->toggleTraditional(traditional);
 
     move(xpos, ypos);
@@ -197,10 +442,23 @@ MainWindow::MainWindow() : model_(new DicModel(dic_, freq_))
     {
         QApplication::setPalette(style->standardPalette());
     }
+
+    QObject::connect(&autosave_, SIGNAL(timeout()), this, SLOT(autoSave()));
+    QObject::connect(&saving_, SIGNAL(finished()), this, SLOT(autoSaveFinished()));
+    QObject::connect(&watcher_, SIGNAL(fileChanged(const QString&)), this, SLOT(dictionaryChanged(const QString&)));
+    QObject::connect(&watcher_, SIGNAL(directoryChanged(const QString&)), this, SLOT(dictionaryChanged(const QString&)));
+    QObject::connect(&reload_, SIGNAL(timeout()), this, SLOT(reloadDictionaries()));
+    QObject::connect(&reloading_, SIGNAL(finished()), this, SLOT(reloadFinished()));
+
+    reload_.setSingleShot(true);
+    asking_ = false;
 }
 
 MainWindow::~MainWindow()
 {
+    saving_.waitForFinished();
+    reloading_.waitForFinished();
+
     QSettings settings("Ensisoft", "Pinyin-Translator");
     settings.setValue("window/width", width());
     settings.setValue("window/height", height());
@@ -212,86 +470,190 @@ MainWindow::~MainWindow()
 
 void MainWindow::loadData()
 {
+    tracer::phase trace("load data");
+
     const auto& homedir = QDir::homePath();
     const auto& pimedir = homedir + "/.pinyin-translator/";
     const auto& local   = pimedir + "local.dic";
 
     QDir dir(pimedir);
-    if (!dir.mkpath(pimedir))
-        throw std::runtime_error("failed to create ~/.pinyin-translator");
+    {
+        tracer::phase trace("create directory");
+        if (!dir.mkpath(pimedir))
+            throw std::runtime_error("failed to create ~/.pinyin-translator");
+    }
+
+    // keep the definitions compressed in memory or leave them
+    // on the disk until they're needed if so configured.
+    QSettings settings("Ensisoft", "Pinyin-Translator");
+    dic_.setCompact(settings.value("dictionary/compact", false).toBool());
+    dic_.setLazy(settings.value("dictionary/lazy", false).toBool());
+
+    // the frequencies are loaded first so that the words get
+    // their frequencies as they're loaded.
+    const auto& instdir  = QApplication::applicationDirPath();
+    const auto& datadir  = instdir + "/data/";
+    const auto& freq     = datadir + "frequency.txt";
+    {
+        tracer::phase trace("load character frequencies");
+        trace.setFileSize(QFileInfo(freq).size());
+        freq_.load(freq);
+    }
+    qDebug() << "Loaded word frequency data " << freq << " with "
+             << freq_.freqCount() << " words";
+
+    // word and word pair frequencies are optional
+    const auto& words = datadir + "words.txt";
+    if (QFileInfo(words).exists())
+    {
+        tracer::phase trace("load word frequencies");
+        trace.setFileSize(QFileInfo(words).size());
+        words_.load(words);
+        qDebug() << "Loaded word frequency data " << words << " with "
+                 << words_.wordCount() << " words and "
+                 << words_.bigramCount() << " word pairs";
+    }
+
+    dic_.setFrequencies(&freq_, &words_);
 
     std::size_t wordCount = 0;
 
     // load local dictionary (if any). this is where new words are stored by default.
     meta data;
-    data.file   = local;
-    data.metaid = 1;
-    meta_.insert(std::make_pair(1, data));
+    data.file     = local;
+    data.metaid   = 1;
+    data.compiled = false;
+    data.saved    = 0;
+    data.size     = 0;
+    data.checksum = 0;
     if (QFileInfo(local).exists())
     {
+        tracer::phase trace("load local dictionary");
+        trace.setFileSize(QFileInfo(local).size());
         dic_.load(local, 1);
-        wordCount = dic_.wordCount();
+        data.saved = dic_.generation();
+        wordCount  = dic_.wordCount();
+        stamp(data);
         qDebug() << "Loaded local dictionary " << local << " with " << wordCount << " words";
     }
+    meta_.insert(std::make_pair(1, data));
 
     // load our "global" dictionary. this is the one that comes with the application.
-    const auto& instdir = QApplication::applicationDirPath();
-    const auto& datadir = instdir + "/data/";
-    const auto& global  = datadir + "cedict.dic";
-    const auto& freq    = datadir + "frequency.txt";
-    data.file   = global;
-    data.metaid = 2;
-    dic_.load(global, 2);
+    // prefer the compiled version if it's been installed since it needs no processing.
+    const auto& compiled = datadir + "cedict.bin";
+    const auto& global   = QFileInfo(compiled).exists() ? compiled : datadir + "cedict.dic";
+    data.file     = global;
+    data.metaid   = 2;
+    data.compiled = global == compiled;
+    {
+        tracer::phase trace("load global dictionary");
+        trace.setFileSize(QFileInfo(global).size());
+        dic_.load(global, 2);
+    }
+    // the deltas below make the global dictionary dirty.
+    data.saved = dic_.generation();
     meta_.insert(std::make_pair(2, data));
 
     qDebug() << "Loaded global dictionary " << global << " with " 
              << dic_.wordCount() - wordCount << " words";
     wordCount = dic_.wordCount();
 
-    freq_.load(freq);
-    qDebug() << "Loaded word frequency data " << freq << " with "
-             << freq_.freqCount() << " words";
+    // apply any updates to the global dictionary (see cedict -d).
+    // the delta files are retired once the global dictionary has been saved.
+    // a delta that changed nothing is already in the saved dictionary.
+    QStringList deltas = dir.entryList(QStringList("*.delta"));
+    for (const auto& file : deltas)
+    {
+        tracer::phase trace("apply delta");
+        trace.setFileSize(QFileInfo(pimedir + file).size());
+        const auto changes = dic_.apply(pimedir + file, 2);
+        qDebug() << "Applied " << pimedir + file << " with " << changes << " changes";
+        if (changes)
+            deltas_ << pimedir + file;
+        else retire_delta(pimedir + file);
+    }
 
-    // load any other .dic files in user home
-    quint32 metaid = 3;
-    QStringList filter("*.dic");
-    QStringList dics = dir.entryList(filter);
-    for (const auto& file : dics)
+    // load the user's word selection history
+    const auto& usage = pimedir + "usage.txt";
+    if (QFileInfo(usage).exists())
     {
-        if (file == "local.dic")
-            continue;
+        tracer::phase trace("load usage");
+        trace.setFileSize(QFileInfo(usage).size());
+        usage_.load(usage);
+        qDebug() << "Loaded word usage data " << usage << " with "
+                 << usage_.usageCount() << " words";
+    }
 
-        meta data;
-        data.file = pimedir + file;
-        data.metaid = metaid;
-        qDebug() << "Loading: " << pimedir + file;
+    // load any other .dic files in user home
+    {
+        tracer::phase trace("scan dictionaries");
 
-        dic_.load(pimedir + file, metaid);
-        meta_.insert(std::make_pair(metaid, data));
-        ++metaid;
+        quint32 metaid = 3;
+        QStringList filter("*.dic");
+        QStringList dics = dir.entryList(filter);
+        for (const auto& file : dics)
+        {
+            if (file == "local.dic")
+                continue;
+
+            meta data;
+            data.file     = pimedir + file;
+            data.metaid   = metaid;
+            data.compiled = false;
+            data.size     = 0;
+            data.checksum = 0;
+            qDebug() << "Loading: " << pimedir + file;
+
+            tracer::phase trace("load dictionary");
+            trace.setFileSize(QFileInfo(data.file).size());
+            dic_.load(pimedir + file, metaid);
+            data.saved = dic_.generation();
+            stamp(data);
+            meta_.insert(std::make_pair(metaid, data));
+            ++metaid;
+        }
     }
 
     NOTE(QString("Loaded dictionary with %1 words").arg(dic_.wordCount()));            
 
-    updateDictionary("");
+    {
+        tracer::phase trace("update dictionary");
+        updateDictionary("");
+    }
     updateWordCount();    
+
+    usageSaved_ = usage_.generation();
+    autosave_.start(AUTOSAVE_INTERVAL);
+
+    // pick up the dictionary files that are added or changed
+    // in the user home while we're running.
+    watcher_.addPath(pimedir);
+    for (const auto& meta : meta_)
+    {
+        if (meta.first == 2)
+            continue;
+        if (QFileInfo(meta.second.file).exists())
+            watcher_.addPath(meta.second.file);
+    }
 }
 
 bool MainWindow::saveData()
 {
-    try
+    autosave_.stop();
+
+    // let the background save complete first so that the data
+    // isn't written twice at the same time.
+    if (saving_.isRunning())
     {
-        for (const auto& meta : meta_)
-        {
-            const auto& file = meta.second.file;
-            const auto& metaid = meta.second.metaid;
-            qDebug() << "Saving words to " << file;            
-            dic_.save(file, metaid);
-        }
+        saving_.waitForFinished();
+        autoSaveFinished();
     }
-    catch (const std::exception& e)
+
+    const auto& job = trySave(makeSaveJob());
+    finishSaveJob(job);
+    if (!job.error.isEmpty())
     {
-        const auto what = QString::fromUtf8(e.what());
+        const auto& what = job.error;
 
         QMessageBox msg(this);
         msg.setIcon(QMessageBox::Critical);
@@ -301,7 +663,10 @@ bool MainWindow::saveData()
         msg.setWindowTitle(windowTitle());
         msg.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
         if (msg.exec() == QMessageBox::No)
+        {
+            autosave_.start(AUTOSAVE_INTERVAL);
             return false;
+        }
     }
     return true;
 }
@@ -328,11 +693,12 @@ void MainWindow::on_actionNewWord_triggered()
     word.simplified  = dlg.simplified();
     word.pinyin      = dlg.pinyin();
     word.description = dlg.desc();
+    word.definition  = dictionary::word::NoDefinition;
     word.meta        = 1;
     word.erased      = false;
     word.frequency   = 0;
     dic_.store(word);
-    model_->update(key);
+    updateDictionary(key);
 
     NOTE(QString("Added %1").arg(word.traditional));
 
@@ -344,7 +710,7 @@ void MainWindow::on_actionNewText_triggered()
     ui_.editInput->clear();
     ui_.editInput->setFocus();
 
-    line_.clear();
+    doc_.clear();
     updateTranslation();    
     updateDictionary("");
 }
@@ -415,6 +781,75 @@ void MainWindow::on_actionFind_triggered()
 {
 }
 
+void MainWindow::on_actionTransliterate_triggered()
+{
+    auto* clipboard = QApplication::clipboard();
+
+    const auto& text = clipboard->text();
+    if (text.isEmpty())
+    {
+        NOTE("No text in the clipboard");
+        return;
+    }
+    clipboard->setText(transliteration().transliterate(text));
+
+    NOTE(QString("Copied pinyin of %1 characters to the clipboard").arg(text.size()));
+}
+
+void MainWindow::on_actionConvert_triggered()
+{
+    auto* clipboard = QApplication::clipboard();
+
+    const auto& text = clipboard->text();
+    if (text.isEmpty())
+    {
+        NOTE("No text in the clipboard");
+        return;
+    }
+    const auto simplified = ui_.actionSimplified->isChecked();
+    const auto to = simplified ? converter::script::simplified : converter::script::traditional;
+    clipboard->setText(conversions().convert(text, to));
+
+    NOTE(QString("Copied %1 text to the clipboard").arg(simplified ? "simplified" : "traditional"));
+}
+
+void MainWindow::convert(conversion what, const QString& in, const QString& out)
+{
+    QFile input(in);
+    if (!input.open(QIODevice::ReadOnly))
+        throw std::runtime_error(utf8("open file failed: _1", in));
+
+    QTextStream is(&input);
+    is.setCodec("UTF-8");
+
+    const auto run = [&](QTextStream& os) {
+        if (what == conversion::pinyin)
+            transliteration().transliterate(is, os);
+        else if (what == conversion::simplified)
+            conversions().convert(is, os, converter::script::simplified);
+        else conversions().convert(is, os, converter::script::traditional);
+    };
+
+    if (out.isEmpty())
+    {
+        QFile output;
+        output.open(stdout, QIODevice::WriteOnly);
+        QTextStream os(&output);
+        os.setCodec("UTF-8");
+        run(os);
+        return;
+    }
+
+    savefile output(out);
+    QTextStream os(output.device());
+    os.setCodec("UTF-8");
+    run(os);
+    if (os.status() != QTextStream::Ok)
+        throw std::runtime_error(utf8("write file failed: _1", out));
+
+    output.commit();
+}
+
 
 void MainWindow::on_editInput_textEdited(const QString& text)
 {
@@ -440,14 +875,10 @@ void MainWindow::on_editInput_textEdited(const QString& text)
 void MainWindow::on_tableView_doubleClicked(const QModelIndex& index)
 {
     const auto input = ui_.editInput->text();
-    if (input.isEmpty())
-        return;
-
     const auto row   = index.row();
 
     translate(row, input);
-    updateTranslation();
-    updateDictionary("");
+    updatePrediction();
 
     ui_.editInput->clear();
     ui_.editInput->setFocus();
@@ -455,6 +886,15 @@ void MainWindow::on_tableView_doubleClicked(const QModelIndex& index)
 
 bool MainWindow::eventFilter(QObject* receiver, QEvent* event)
 {
+    if (receiver == ui_.lblInfoText && event->type() == QEvent::ToolTip)
+    {
+        // the breakdown walks all the words so it's only
+        // computed when the tooltip is about to be shown.
+        const auto* help = static_cast<const QHelpEvent*>(event);
+        QToolTip::showText(help->globalPos(),
+            "<pre>" + Qt::escape(memoryReport()) + "</pre>", ui_.lblInfoText);
+        return true;
+    }
     if (receiver != ui_.editInput)
         return QMainWindow::eventFilter(receiver, event);
     if (event->type() != QEvent::KeyPress)
@@ -466,11 +906,12 @@ bool MainWindow::eventFilter(QObject* receiver, QEvent* event)
     {
         if (input.isEmpty())
         {
-            if (!line_.empty())
+            // take the word before the cursor back for editing.
+            if (doc_.cursor())
             {
-                const auto key = line_.back().key;
-                line_.pop_back();
-                updateTranslation();
+                const auto pos = doc_.cursor() - 1;
+                const auto key = doc_.at(pos).key;
+                eraseTranslation(pos);
                 updateDictionary(key);
                 ui_.editInput->setText(key);
             }
@@ -478,6 +919,24 @@ bool MainWindow::eventFilter(QObject* receiver, QEvent* event)
         }
         return QMainWindow::eventFilter(receiver, event);
     }
+    else if (input.isEmpty() && (press->key() == Qt::Key_Left || press->key() == Qt::Key_Right ||
+             press->key() == Qt::Key_Home || press->key() == Qt::Key_End))
+    {
+        // move between the translated words.
+        auto pos = doc_.cursor();
+        if (press->key() == Qt::Key_Left && pos)
+            --pos;
+        else if (press->key() == Qt::Key_Right)
+            ++pos;
+        else if (press->key() == Qt::Key_Home)
+            pos = 0;
+        else if (press->key() == Qt::Key_End)
+            pos = doc_.size();
+        doc_.setCursor(pos);
+        updateCursor();
+        updatePrediction();
+        return true;
+    }
 
     int wordindex = 0;
     switch (press->key())
@@ -504,8 +963,7 @@ bool MainWindow::eventFilter(QObject* receiver, QEvent* event)
     qDebug() << "Input word: " << input;
 
     translate(wordindex-1, input);                
-    updateTranslation();
-    updateDictionary("");
+    updatePrediction();
 
     ui_.editInput->clear();
     return true;
@@ -524,60 +982,508 @@ void MainWindow::closeEvent(QCloseEvent* close)
     }
 }
 
+void MainWindow::autoSave()
+{
+    if (saving_.isRunning())
+        return;
+
+    job_ = makeSaveJob();
+    if (job_.files.empty() && !job_.usage)
+        return;
+
+    qDebug() << "Autosave started";
+
+    saving_.setFuture(QtConcurrent::run(&MainWindow::trySave, job_));
+}
+
+void MainWindow::autoSaveFinished()
+{
+    if (!job_.version)
+        return;
+
+    const auto& job = saving_.result();
+    finishSaveJob(job);
+    if (job.error.isEmpty())
+    {
+        qDebug() << "Autosave done";
+    }
+    else 
+    {
+        qDebug() << "Autosave failed: " << job.error;
+        NOTE(QString("Autosave failed: %1").arg(job.error));
+    }
+    job_ = savejob();
+}
+
+MainWindow::savejob MainWindow::makeSaveJob() const
+{
+    savejob job;
+    job.version = dic_.current();
+    job.usageGeneration = usage_.generation();
+
+    for (const auto& meta : meta_)
+    {
+        if (job.version->modified(meta.second.metaid) > meta.second.saved)
+            job.files.push_back(meta.second);
+    }
+    if (job.usageGeneration != usageSaved_)
+        job.usage.reset(new usagetable(usage_));
+
+    // the deltas are retired once the global dictionary has been saved.
+    for (const auto& file : job.files)
+    {
+        if (file.metaid == 2)
+            job.deltas = deltas_;
+    }
+    return job;
+}
+
+void MainWindow::finishSaveJob(const savejob& job)
+{
+    // only the files that were written. the dictionary
+    // might have been removed while saving.
+    for (const auto& file : job.files)
+    {
+        if (file.saved != job.version->generation())
+            continue;
+        auto it = meta_.find(file.metaid);
+        if (it == std::end(meta_))
+            continue;
+        auto& meta = it->second;
+        meta.saved    = file.saved;
+        meta.stamp    = file.stamp;
+        meta.size     = file.size;
+        meta.checksum = file.checksum;
+    }
+    if (!job.error.isEmpty())
+        return;
+
+    if (job.usage)
+        usageSaved_ = job.usageGeneration;
+
+    for (const auto& delta : job.deltas)
+        deltas_.removeAll(delta);
+}
+
+// this runs on a background thread when autosaving so it may
+// only touch the data in the job.
+void MainWindow::save(savejob& job)
+{
+    QStringList conflicts;
+
+    // save all the files from the same version of the dictionary.
+    for (auto& meta : job.files)
+    {
+        // the file has been changed outside since it was loaded.
+        // the change is picked up by the reload and the user decides
+        // which one to keep, until then the file isn't overwritten.
+        if (changed(meta))
+        {
+            qDebug() << "Not overwriting changed file " << meta.file;
+            conflicts << QFileInfo(meta.file).fileName();
+            continue;
+        }
+        qDebug() << "Saving words to " << meta.file;
+        if (meta.compiled)
+            job.version->compile(meta.file, meta.metaid);
+        else job.version->save(meta.file, meta.metaid);
+
+        meta.saved = job.version->generation();
+        stamp(meta);
+    }
+    if (!conflicts.isEmpty())
+        throw std::runtime_error(utf8("_1 has been changed outside, not overwriting it", conflicts.join(", ")));
+
+    if (job.usage)
+    {
+        const auto& usage = QDir::homePath() + "/.pinyin-translator/usage.txt";
+        qDebug() << "Saving word usage to " << usage;
+        job.usage->save(usage);
+    }
+
+    for (const auto& delta : job.deltas)
+        retire_delta(delta);
+}
+
+MainWindow::savejob MainWindow::trySave(savejob job)
+{
+    try
+    {
+        save(job);
+    }
+    catch (const std::exception& e)
+    {
+        job.error = QString::fromUtf8(e.what());
+    }
+    return job;
+}
+
+void MainWindow::dictionaryChanged(const QString& file)
+{
+    qDebug() << "File changed: " << file;
+
+    if (!changed_.contains(file))
+        changed_ << file;
+
+    // editors often write the file in several steps.
+    reload_.start(RELOAD_DELAY);
+}
+
+void MainWindow::reloadDictionaries()
+{
+    // the rest of the changes are picked up once this is done.
+    if (reloading_.isRunning() || asking_)
+        return;
+
+    // our own save might be in progress. wait for it to finish
+    // so that it isn't taken for an outside change.
+    if (saving_.isRunning())
+    {
+        reload_.start(RELOAD_DELAY);
+        return;
+    }
+
+    const auto& pimedir = QDir::homePath() + "/.pinyin-translator/";
+
+    while (!changed_.isEmpty())
+    {
+        const auto file = changed_.takeFirst();
+        if (QFileInfo(file).absoluteFilePath() == QFileInfo(pimedir).absoluteFilePath())
+        {
+            // find the removed dictionary files. the local and
+            // global dictionaries are always kept.
+            for (auto it = meta_.begin(); it != meta_.end(); )
+            {
+                const auto& meta = it->second;
+                if (meta.metaid < 3 || QFileInfo(meta.file).exists())
+                {
+                    ++it;
+                    continue;
+                }
+                qDebug() << "Dictionary removed: " << meta.file;
+                NOTE(QString("Removed %1").arg(QFileInfo(meta.file).fileName()));
+                watcher_.removePath(meta.file);
+                dic_.unload(meta.metaid);
+                it = meta_.erase(it);
+            }
+            // find the new dictionary files.
+            for (const auto& name : QDir(pimedir).entryList(QStringList("*.dic")))
+            {
+                const auto& path = pimedir + name;
+                const auto known = std::find_if(std::begin(meta_), std::end(meta_),
+                    [&](const std::pair<const quint32, meta>& m) {
+                        return m.second.file == path;
+                    });
+                if (known == std::end(meta_) && !changed_.contains(path))
+                    changed_ << path;
+            }
+            updateWordCount();
+            continue;
+        }
+
+        if (!QFileInfo(file).exists())
+            continue;
+
+        // a file that is replaced by renaming is no longer watched.
+        if (!watcher_.files().contains(file))
+            watcher_.addPath(file);
+
+        reloadjob job;
+        auto it = std::find_if(std::begin(meta_), std::end(meta_),
+            [&](const std::pair<const quint32, meta>& m) {
+                return m.second.file == file;
+            });
+        if (it == std::end(meta_))
+        {
+            job.data.file     = file;
+            job.data.metaid   = meta_.rbegin()->first + 1;
+            job.data.compiled = false;
+            job.data.saved    = 0;
+            job.data.size     = 0;
+            job.data.checksum = 0;
+        }
+        else
+        {
+            job.data = it->second;
+
+            // our own save or no real change.
+            if (!changed(job.data))
+                continue;
+
+            // the file and the dictionary have both been changed.
+            // let the user decide which changes to keep.
+            if (dic_.current()->modified(job.data.metaid) > job.data.saved)
+            {
+                qDebug() << "Modified dictionary changed outside: " << file;
+
+                const auto& name = QFileInfo(file).fileName();
+                QMessageBox msg(this);
+                msg.setIcon(QMessageBox::Question);
+                msg.setText(QString(
+                    "%1 has been changed by another program but it also has unsaved changes.\n"
+                    "Do you want to load it again and lose the unsaved changes?").arg(name));
+                msg.setWindowTitle(windowTitle());
+                msg.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+                asking_ = true;
+                const auto answer = msg.exec();
+                asking_ = false;
+
+                // the file might have been removed while asking.
+                it = std::find_if(std::begin(meta_), std::end(meta_),
+                    [&](const std::pair<const quint32, meta>& m) {
+                        return m.second.file == file;
+                    });
+                if (it == std::end(meta_))
+                    continue;
+                if (answer == QMessageBox::No)
+                {
+                    // keep our changes and write them over the file on the next save.
+                    stamp(it->second);
+                    NOTE(QString("Keeping the changes to %1").arg(name));
+                    continue;
+                }
+                job.data = it->second;
+            }
+        }
+        job.generation = 0;
+
+        qDebug() << "Reloading: " << file;
+
+        reloading_.setFuture(QtConcurrent::run(&MainWindow::tryReload, &dic_, job));
+        return;
+    }
+}
+
+void MainWindow::reloadFinished()
+{
+    const auto& job = reloading_.result();
+    if (job.error.isEmpty())
+    {
+        auto& meta = meta_[job.data.metaid];
+        meta = job.data;
+        meta.saved = job.generation;
+
+        NOTE(QString("Loaded %1").arg(QFileInfo(meta.file).fileName()));
+
+        // the current translations might have changed.
+        on_editInput_textEdited(ui_.editInput->text());
+        updateWordCount();
+    }
+    else
+    {
+        qDebug() << "Reload failed: " << job.error;
+        NOTE(QString("Failed to load %1: %2").arg(QFileInfo(job.data.file).fileName()).arg(job.error));
+    }
+
+    if (!changed_.isEmpty())
+        reloadDictionaries();
+}
+
+// this runs on a background thread. the dictionary keeps
+// serving the previous version until the new one is ready.
+MainWindow::reloadjob MainWindow::tryReload(dictionary* dic, reloadjob job)
+{
+    try
+    {
+        // take the stamp before reading so that a change made
+        // while reading is noticed.
+        stamp(job.data);
+        job.generation = dic->reload(job.data.file, job.data.metaid);
+    }
+    catch (const std::exception& e)
+    {
+        job.error = QString::fromUtf8(e.what());
+    }
+    return job;
+}
+
+void MainWindow::stamp(meta& data)
+{
+    const QFileInfo info(data.file);
+    data.stamp = info.lastModified();
+    data.size  = info.size();
+
+    // the global dictionary isn't edited outside
+    // and it's too big to be hashed all the time.
+    data.checksum = data.metaid == 2 ? 0 : hash_file(data.file);
+}
+
+bool MainWindow::changed(const meta& data)
+{
+    if (data.metaid == 2)
+        return false;
+
+    const QFileInfo info(data.file);
+    if (!info.exists())
+        return false;
+    if (info.lastModified() != data.stamp || info.size() != data.size)
+        return true;
+    return hash_file(data.file) != data.checksum;
+}
+
 void MainWindow::translate(int index, const QString& key)
 {
     if (index >= model_->size())
     {
-        word w;
+        if (key.isEmpty())
+            return;
+
+        document::word w;
         w.key         = key;
         w.pinyin      = key;
         w.traditional = key;
         w.simplified  = key;
-        line_.push_back(w);
+        doc_.insert(w);
     }
     else
     {
+        model_->select(index);
+
+        // when the word was picked from the predictions there's no input.
         const auto& translate = model_->getWord(index);
-        word w;
-        w.key         = key;
+        document::word w;
+        w.key         = key.isEmpty() ? translate.key : key;
         w.pinyin      = translate.pinyin;
         w.traditional = translate.traditional;
         w.simplified  = translate.simplified;
-        line_.push_back(w);
+        doc_.insert(w);
     }
+    insertTranslation(doc_.cursor() - 1);
 }
 
 void MainWindow::updateDictionary(const QString& key)
 {
     qDebug() << "Dictionary key: " << key;
 
-    model_->update(key);
+    const auto& previous = doc_.cursor()
+        ? doc_.at(doc_.cursor() - 1).simplified : QString();
+    model_->update(key, previous);
+}
+
+void MainWindow::updatePrediction()
+{
+    if (!doc_.cursor())
+    {
+        updateDictionary("");
+        return;
+    }
+    const auto& previous = doc_.at(doc_.cursor() - 1).simplified;
+
+    qDebug() << "Previous word: " << previous;
+
+    model_->predict(previous);
 }
 
 void MainWindow::updateTranslation()
 {
     bool simplified = ui_.actionSimplified->isChecked();
 
-    QString chinese;
-    QString pinyin;
-    for (const auto& tok : line_)
+    ui_.editPinyin->setText(doc_.pinyinText());
+    ui_.editChinese->setText(doc_.hanziText(simplified));
+    updateCursor();
+}
+
+// change only the text of the word instead of setting all the
+// text again so that long texts stay quick to edit.
+void MainWindow::insertTranslation(std::size_t pos)
+{
+    bool simplified = ui_.actionSimplified->isChecked();
+
+    const auto& word = doc_.at(pos);
+    ui_.editChinese->setCursorPosition(doc_.hanziOffset(pos, simplified));
+    ui_.editChinese->insert(document::hanzi(word, simplified));
+    ui_.editPinyin->setCursorPosition(doc_.pinyinOffset(pos));
+    ui_.editPinyin->insert(document::pinyin(word));
+    updateCursor();
+}
+
+void MainWindow::eraseTranslation(std::size_t pos)
+{
+    bool simplified = ui_.actionSimplified->isChecked();
+
+    const auto& word = doc_.at(pos);
+    ui_.editChinese->setSelection(doc_.hanziOffset(pos, simplified),
+        document::hanzi(word, simplified).size());
+    ui_.editChinese->insert("");
+    ui_.editPinyin->setSelection(doc_.pinyinOffset(pos),
+        document::pinyin(word).size());
+    ui_.editPinyin->insert("");
+
+    doc_.erase(pos);
+    updateCursor();
+}
+
+void MainWindow::updateCursor()
+{
+    bool simplified = ui_.actionSimplified->isChecked();
+
+    const auto pos = doc_.cursor();
+    ui_.editChinese->setCursorPosition(doc_.hanziOffset(pos, simplified));
+    ui_.editPinyin->setCursorPosition(doc_.pinyinOffset(pos));
+}
+
+const transliterator& MainWindow::transliteration()
+{
+    // the trie is built on first use and again after the words change.
+    if (pinyinGeneration_ != dic_.generation())
     {
-        if (simplified)
-            chinese += tok.simplified;
-        else chinese += tok.traditional;
-        pinyin  += QString("%1 ").arg(tok.pinyin);
+        const auto& version = dic_.current();
+        pinyin_.build(*version);
+        pinyinGeneration_ = version->generation();
     }
+    return pinyin_;
+}
 
-    ui_.editPinyin->setText(pinyin);
-    ui_.editChinese->setText(chinese);
+const converter& MainWindow::conversions()
+{
+    if (scriptGeneration_ != dic_.generation())
+    {
+        const auto& version = dic_.current();
+        script_.build(*version);
+        scriptGeneration_ = version->generation();
+    }
+    return script_;
 }
 
+// this is called after every change so it only shows the cheap
+// word count. the memory breakdown is shown in the tooltip of the
+// word count and printed with --memory.
 void MainWindow::updateWordCount()
 {
     ui_.lblInfoText->setText(
         QString("%1 words").arg(dic_.wordCount()));
 }
 
+QString MainWindow::memoryReport() const
+{
+    const auto& dic  = dic_.memoryUsage();
+    const auto& freq = freq_.memoryUsage();
+
+    QString ret;
+    QTextStream stream(&ret);
+    stream << "dictionary\n";
+    stream << "  records     " << dic.records << "\n";
+    stream << "  strings     " << dic.strings << "\n";
+    stream << "  index       " << dic.index << "\n";
+    stream << "  tombstones  " << dic.tombstones << "\n";
+    stream << "  definitions " << dic.definitions << "\n";
+    stream << "  mapped      " << dic.mapped << " (shared)\n";
+    for (const auto& meta : dic.metas)
+    {
+        const auto it = meta_.find(meta.first);
+        stream << "  meta " << meta.first << "      " << meta.second;
+        if (it != std::end(meta_))
+            stream << " " << it->second.file;
+        stream << "\n";
+    }
+    stream << "freqtable\n";
+    stream << "  index       " << freq.index << "\n";
+    stream << "  strings     " << freq.strings << "\n";
+    stream << "total         " << dic.total() + freq.total() << "\n";
+    stream.flush();
+    return ret;
+}
+
 void MainWindow::setFont(QFont font)
 {
     ui_.editChinese->setFont(font);
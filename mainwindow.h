@@ -28,13 +28,22 @@
 #  include <QtGui/QMainWindow>
 #  include <QtGui/QFont>
 #  include <QObject>
+#  include <QTimer>
+#  include <QDateTime>
+#  include <QFileSystemWatcher>
+#  include <QFutureWatcher>
 #  include "ui_mainwindow.h"
 #include "warnpop.h"
-#include <list>
 #include <memory>
 #include <map>
+#include <vector>
 #include "dictionary.h"
 #include "freqtable.h"
+#include "wordtable.h"
+#include "usagetable.h"
+#include "document.h"
+#include "transliterator.h"
+#include "converter.h"
 
 namespace pime
 {
@@ -51,6 +60,17 @@ namespace pime
         void loadData();
         bool saveData();
 
+        // get a breakdown of the memory used by the loaded data.
+        QString memoryReport() const;
+
+        enum class conversion {
+            pinyin, traditional, simplified
+        };
+
+        // convert a Chinese text file to pinyin or to the other script.
+        // if the output file is empty the result is written to the stdout.
+        void convert(conversion what, const QString& in, const QString& out);
+
     private slots:
         void on_actionExit_triggered();
         void on_actionNewWord_triggered();
@@ -61,37 +81,94 @@ namespace pime
         void on_actionAbout_triggered();
         void on_actionFont_triggered();
         void on_actionFind_triggered();
+        void on_actionTransliterate_triggered();
+        void on_actionConvert_triggered();
         void on_editInput_textEdited(const QString& text);
         void on_tableView_doubleClicked(const QModelIndex& index);
+        void autoSave();
+        void autoSaveFinished();
+        void dictionaryChanged(const QString& file);
+        void reloadDictionaries();
+        void reloadFinished();
     private:
         bool eventFilter(QObject* reciver, QEvent* event) override;
         void closeEvent(QCloseEvent* event);
         void translate(int index, const QString& key);
         void updateDictionary(const QString& key);
+        void updatePrediction();
         void updateTranslation();
+        void insertTranslation(std::size_t pos);
+        void eraseTranslation(std::size_t pos);
+        void updateCursor();
         void updateWordCount();
         void setFont(QFont f);
+        const transliterator& transliteration();
+        const converter& conversions();
 
     private:
         class DicModel;
 
-        struct word {
-            QString key;
-            QString pinyin;
-            QString traditional;
-            QString simplified;
-        };
         struct meta {
             QString file;
             quint32 metaid;
+            bool compiled;
+            // the dictionary generation that has been saved to the file.
+            quint32 saved;
+            // the file as it was when last loaded or saved, used for
+            // telling the outside changes apart from our own.
+            QDateTime stamp;
+            qint64 size;
+            uint checksum;
+        };
+        static void stamp(meta& data);
+        static bool changed(const meta& data);
+
+        // the modified data to be saved. the data is copied so that
+        // the job can run on a background thread.
+        struct savejob {
+            dictionary::version version;
+            std::vector<meta> files;
+            std::shared_ptr<usagetable> usage;
+            quint32 usageGeneration;
+            QStringList deltas;
+            QString error;
+        };
+        savejob makeSaveJob() const;
+        void finishSaveJob(const savejob& job);
+        static void save(savejob& job);
+        static savejob trySave(savejob job);
+
+        // a dictionary file that is loaded again on a background thread.
+        struct reloadjob {
+            meta data;
+            quint32 generation;
+            QString error;
         };
+        static reloadjob tryReload(dictionary* dic, reloadjob job);
 
-        std::list<word> line_;
+        document doc_;
         std::unique_ptr<DicModel> model_;
         std::unique_ptr<DlgDictionary> dlg_;
         std::map<quint32, meta> meta_;
+        QStringList deltas_;
         dictionary dic_;
         freqtable freq_;
+        wordtable words_;
+        usagetable usage_;
+        quint32 usageSaved_;
+        transliterator pinyin_;
+        quint32 pinyinGeneration_;
+        converter script_;
+        quint32 scriptGeneration_;
+        QTimer autosave_;
+        QFutureWatcher<savejob> saving_;
+        savejob job_;
+        QFileSystemWatcher watcher_;
+        QStringList changed_;
+        QTimer reload_;
+        QFutureWatcher<reloadjob> reloading_;
+        // the user is being asked about a conflicting change.
+        bool asking_;
 
     private:
         Ui::MainWindow ui_;
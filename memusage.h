@@ -0,0 +1,55 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#include "warnpop.h"
+
+#include <cstddef>
+
+// helpers for approximating the memory used by the containers.
+// the numbers are estimates of what the allocator hands out, 
+// they don't include the allocator's own overhead.
+
+namespace pime
+{
+    // the header that QString allocates together with its data.
+    const std::size_t QSTRING_HEADER = 3 * sizeof(int) + 2 * sizeof(void*);
+
+    // bytes allocated for the data of the string when it owns it.
+    inline std::size_t string_bytes(const QString& str)
+    {
+        return QSTRING_HEADER + (str.capacity() + 1) * sizeof(QChar);
+    }
+
+    // bytes allocated for a node of a std::map/std::multimap/std::set.
+    // a red black tree node has the color and 3 links besides the value.
+    template<typename Container>
+    std::size_t node_bytes(const Container&)
+    {
+        return sizeof(typename Container::value_type) + 4 * sizeof(void*);
+    }
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,119 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QtDebug>
+#  include <QFileInfo>
+#include "warnpop.h"
+#include <stdexcept>
+#include <cstdio>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#  include <io.h>
+#else
+#  include <unistd.h>
+#  include <fcntl.h>
+#endif
+
+#include "savefile.h"
+#include "format.h"
+
+namespace {
+
+bool sync_file(int handle)
+{
+#if defined(_WIN32)
+    return _commit(handle) == 0;
+#else
+    return ::fsync(handle) == 0;
+#endif
+}
+
+bool replace_file(const QString& source, const QString& target)
+{
+#if defined(_WIN32)
+    return MoveFileExW((LPCWSTR)source.utf16(), (LPCWSTR)target.utf16(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (std::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()))
+        return false;
+
+    // sync the directory too so that the rename itself is durable.
+    const auto& dir = QFileInfo(target).absolutePath();
+    const auto fd = ::open(QFile::encodeName(dir).constData(), O_RDONLY);
+    if (fd != -1)
+    {
+        ::fsync(fd);
+        ::close(fd);
+    }
+    return true;
+#endif
+}
+
+} // namespace
+
+namespace pime
+{
+
+savefile::savefile(const QString& file) : file_(file), io_(file + ".XXXXXX"), done_(false)
+{
+    // the file is renamed by commit or removed by the destructor.
+    io_.setAutoRemove(false);
+    if (!io_.open())
+        throw std::runtime_error(utf8("open file failed: _1", file));
+
+    temp_ = io_.fileName();
+}
+
+savefile::~savefile()
+{
+    if (done_)
+        return;
+
+    io_.close();
+    QFile::remove(temp_);
+}
+
+void savefile::commit()
+{
+    if (!io_.flush() || !sync_file(io_.handle()))
+        throw std::runtime_error(utf8("write file failed: _1", io_.fileName()));
+
+    io_.close();
+
+    // the temporary file is only accessible by the owner, give it the
+    // permissions of the file it replaces or the usual ones for a new file.
+    const auto perms = QFile::exists(file_) ? QFile::permissions(file_)
+        : QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::ReadOther;
+    if (!QFile::setPermissions(temp_, perms))
+        qWarning() << "Failed to set the permissions of " << temp_;
+
+    if (!replace_file(temp_, file_))
+        throw std::runtime_error(utf8("replace file failed: _1", file_));
+
+    done_ = true;
+    qDebug() << "Saved " << file_;
+}
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,58 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#  include <QFile>
+#  include <QTemporaryFile>
+#include "warnpop.h"
+
+namespace pime
+{
+    // write a file so that a crash or a kill in the middle of writing
+    // never leaves a partially written file behind. the data goes to
+    // a uniquely named temporary file next to the target file so that
+    // concurrent saves don't write into the same file. on commit the
+    // temporary file gets the permissions of the target, is synced to
+    // the disk and then renamed over the target. if the savefile is
+    // destroyed without a commit the target is left untouched.
+    class savefile
+    {
+    public:
+        savefile(const QString& file);
+       ~savefile();
+
+        QIODevice* device()
+        { return &io_; }
+
+        void commit();
+    private:
+        QString file_;
+        QString temp_;
+        QTemporaryFile io_;
+        bool done_;
+    };
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,147 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QtDebug>
+#include "warnpop.h"
+#include <algorithm>
+#include <cstring>
+
+#include "textfile.h"
+#include "format.h"
+
+namespace pime
+{
+
+qint64 textfile::field::toLongLong(bool* ok) const
+{
+    qint64 ret = 0;
+    bool negative = false;
+
+    int i = 0;
+    if (size && (data[0] == '-' || data[0] == '+'))
+        negative = data[i++] == '-';
+
+    bool digits = i < size;
+    for (; i<size; ++i)
+    {
+        if (data[i] < '0' || data[i] > '9')
+        {
+            digits = false;
+            break;
+        }
+        ret = ret * 10 + (data[i] - '0');
+    }
+    if (ok)
+        *ok = digits;
+    if (!digits)
+        return 0;
+    return negative ? -ret : ret;
+}
+
+bool textfile::field::operator==(const field& other) const
+{
+    return size == other.size && !std::memcmp(data, other.data, size);
+}
+
+textfile::textfile(const QString& file) : file_(file), io_(file), line_(0)
+{
+    if (!io_.open(QIODevice::ReadOnly))
+        throw std::runtime_error(utf8("open file failed: _1", file));
+
+    const auto size = io_.size();
+    const auto* data = size ? io_.map(0, size) : nullptr;
+    if (data)
+    {
+        data_ = reinterpret_cast<const char*>(data);
+        end_  = data_ + size;
+    }
+    else
+    {
+        if (size)
+            qDebug() << "Failed to map " << file << " reading it instead.";
+        buffer_ = io_.readAll();
+        data_ = buffer_.constData();
+        end_  = data_ + buffer_.size();
+    }
+    pos_ = beg_ = eol_ = data_;
+}
+
+textfile::textfile(const QString& file, const char* data, qint64 size)
+    : file_(file), data_(data), end_(data + size), pos_(data), beg_(data), eol_(data), line_(0)
+{}
+
+textfile::~textfile()
+{}
+
+bool textfile::next()
+{
+    // skip the byte order mark
+    if (pos_ == data_ && end_ - data_ >= 3 && !std::memcmp(data_, "\xEF\xBB\xBF", 3))
+        pos_ += 3;
+
+    while (pos_ < end_)
+    {
+        // memchr goes through the data several bytes at a time.
+        beg_ = pos_;
+        eol_ = static_cast<const char*>(std::memchr(pos_, '\n', end_ - pos_));
+        if (!eol_)
+            eol_ = end_;
+        pos_ = eol_ + 1;
+        ++line_;
+        if (eol_ > beg_ && eol_[-1] == '\r')
+            --eol_;
+        if (eol_ != beg_)
+            return true;
+    }
+    beg_ = eol_ = end_;
+    return false;
+}
+
+bool textfile::split(char separator, field* fields, int count) const
+{
+    const char* p = beg_;
+    for (int i=0; i<count-1; ++i)
+    {
+        const auto* sep = static_cast<const char*>(std::memchr(p, separator, eol_ - p));
+        if (!sep)
+            return false;
+        fields[i] = field{p, int(sep - p)};
+        p = sep + 1;
+    }
+    fields[count-1] = field{p, int(eol_ - p)};
+    return true;
+}
+
+int textfile::fields(char separator) const
+{
+    return 1 + std::count(beg_, eol_, separator);
+}
+
+std::runtime_error textfile::error(const char* what) const
+{
+    return std::runtime_error(utf8("_1: _2 line _3", what, file_, line_));
+}
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,110 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#  include <QFile>
+#  include <QByteArray>
+#include "warnpop.h"
+#include <stdexcept>
+
+namespace pime
+{
+    // read a UTF-8 text file one line at a time without copying or
+    // decoding it. the file is mapped to memory when possible and the
+    // lines and their fields are only views into the file data so the
+    // caller decodes just the fields it stores.
+    class textfile
+    {
+    public:
+        // a part of the current line.
+        struct field {
+            const char* data;
+            int size;
+
+            bool isEmpty() const
+            { return size == 0; }
+
+            QString toString() const
+            { return QString::fromUtf8(data, size); }
+
+            qint64 toLongLong(bool* ok = nullptr) const;
+
+            bool operator==(const field& other) const;
+        };
+
+        // open the file for reading.
+        textfile(const QString& file);
+
+        // read the lines of the file data that's owned by the caller.
+        textfile(const QString& file, const char* data, qint64 size);
+       ~textfile();
+
+        // move to the next line that is not empty.
+        // returns false when there are no more lines.
+        bool next();
+
+        // split the current line into count fields at the separator.
+        // the last field holds the rest of the line. returns false
+        // if the line has fewer fields.
+        bool split(char separator, field* fields, int count) const;
+
+        // return the number of fields in the current line.
+        int fields(char separator) const;
+
+        // the current line without the line break.
+        field line() const
+        { return field{beg_, int(eol_ - beg_)}; }
+
+        // the 1 based number of the current line.
+        std::size_t lineNumber() const
+        { return line_; }
+
+        // the whole file data.
+        const char* data() const
+        { return data_; }
+        qint64 size() const
+        { return end_ - data_; }
+
+        // the offset of the given data from the start of the file.
+        qint64 offset(const char* data) const
+        { return data - data_; }
+
+        // make an error for the current line.
+        std::runtime_error error(const char* what) const;
+    private:
+        QString file_;
+        QFile io_;
+        QByteArray buffer_;
+        const char* data_;
+        const char* end_;
+        const char* pos_;
+        const char* beg_;
+        const char* eol_;
+        std::size_t line_;
+    };
+
+} // pime
\ No newline at end of file
@@ -1,4 +1,4 @@
-// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft
 //
 // http://www.ensisoft.com
 //
@@ -22,56 +22,143 @@
 
 #include "../config.h"
 #include "../warnpush.h"
-#  include <boost/spirit/include/classic.hpp>
+#  include <boost/interprocess/file_mapping.hpp>
+#  include <boost/interprocess/mapped_region.hpp>
 #  include "../pinyin.h"
 #include "../warnpop.h"
+#include "../dicfile.h"
 
 // data file location
 // http://www.mdbg.net/chindict/chindict.php?page=cc-cedict
 
+#include <algorithm>
 #include <string>
+#include <vector>
+#include <thread>
 #include <iostream>
 #include <fstream>
-#include <stack>
-#include <map>
+#include <unordered_map>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <cassert>
+#include <cstdio>
+#include <random>
 #include "utf8.h"
 
-struct word {
-    std::string traditional;
-    std::string simplified;
-    std::string pinyin;
-    std::string definition;
+// a non-owning view into the memory mapped input file.
+struct range {
+    const char* beg;
+    const char* end;
+
+    bool empty() const
+    { return beg == end; }
 };
 
-bool parse_word(const std::string& line, word& w)
+// a whole input file mapped for reading.
+struct input {
+    boost::interprocess::file_mapping mapping;
+    boost::interprocess::mapped_region region;
+    range data;
+};
+
+// map the file for reading. an empty file can't be mapped
+// so its data is left as an empty range.
+bool open_input(const std::string& file, input& in)
 {
-    using namespace boost::spirit::classic;
-
-    chset<> trad_p(chset<>(anychar_p) - '\r' - '\n' - ' ');
-    chset<> simp_p(chset<>(anychar_p) - '\r' - '\n' - ' ');    
-    chset<> pinyin_p(chset<>(anychar_p) - '\r' - '\n' - ']');    
-
-    const auto ret = parse(std::begin(line), std::end(line),
-        (
-            (*trad_p)[assign(w.traditional)] >> ch_p(' ') >>
-            (*simp_p)[assign(w.simplified)] >> ch_p(' ')  >>
-            (ch_p('[') >> (*pinyin_p)[assign(w.pinyin)] >> ch_p(']')) >> ch_p(' ') >> !ch_p('/') >>
-            (*anychar_p)[assign(w.definition)]
-        ));
-    return ret.hit;
+    namespace ipc = boost::interprocess;
+
+    in.data = range{nullptr, nullptr};
+
+    std::ifstream probe(file, std::ios::binary | std::ios::ate);
+    if (!probe.is_open())
+    {
+        std::cerr << "Failed to open: " << file << "\n";
+        return false;
+    }
+    if (probe.tellg() == 0)
+        return true;
+
+    try
+    {
+        in.mapping = ipc::file_mapping(file.c_str(), ipc::read_only);
+        in.region  = ipc::mapped_region(in.mapping, ipc::read_only);
+    }
+    catch (const ipc::interprocess_exception& e)
+    {
+        std::cerr << "Failed to open: " << file << " (" << e.what() << ")\n";
+        return false;
+    }
+    const char* beg = static_cast<const char*>(in.region.get_address());
+    in.data = range{beg, beg + in.region.get_size()};
+    return true;
 }
 
-std::string make_dictionary_key(std::string pinyin)
+struct word {
+    range traditional;
+    range simplified;
+    range pinyin;
+    range definition;
+};
+
+// scratch buffers owned by each parsing thread. they're reused
+// for every word so that we don't need to allocate per line.
+struct buffers {
+    std::wstring wide;
+    std::wstring syllable;
+};
+
+// the result of parsing one chunk of the input file.
+// each chunk produces its own output buffer so that the
+// chunks can be parsed in parallel and then written out in order.
+struct chunk {
+    range input;
+    std::string output;
+    std::size_t lines;
+    std::size_t words;
+    // if the parsing failed this is the offending line
+    // and its line number relative to the start of the chunk.
+    range error;
+    std::size_t errline;
+};
+
+// parse a single CC-CEDICT line of the form
+// TRADITIONAL SIMPLIFIED [pin1 yin1] /definition 1/definition 2/
+bool parse_word(const char* beg, const char* end, word& w)
 {
-    auto it = std::remove_if(std::begin(pinyin), std::end(pinyin),
-        [&](char c) {
-            return std::isdigit(c) || std::isspace(c);
-        });
-    pinyin.erase(it, std::end(pinyin));
-    return pinyin;
+    const char* pos = beg;
+
+    const char* space = std::find(pos, end, ' ');
+    if (space == end)
+        return false;
+    w.traditional = range{pos, space};
+    pos = space + 1;
+
+    space = std::find(pos, end, ' ');
+    if (space == end)
+        return false;
+    w.simplified = range{pos, space};
+    pos = space + 1;
+
+    if (pos == end || *pos != '[')
+        return false;
+    const char* bracket = std::find(++pos, end, ']');
+    if (bracket == end)
+        return false;
+    w.pinyin = range{pos, bracket};
+    pos = bracket + 1;
+
+    if (pos == end || *pos != ' ')
+        return false;
+    if (++pos != end && *pos == '/')
+        ++pos;
+
+    w.definition = range{pos, end};
+    return true;
 }
 
-std::string make_dictionary_pinyin(std::string pinyin)
+void make_dictionary_pinyin(range pinyin, buffers& buff, std::string& out)
 {
     // transform something like "ban4 fa3" into "bànfǎ"
     // the algorithm for placing the tone mark in the syllable is
@@ -80,25 +167,27 @@ std::string make_dictionary_pinyin(std::string pinyin)
     // if there's an "ou", then the "o" takes the tone mark
     // else the second vowel takes the tone mark
 
+    auto& wide = buff.wide;
+    auto& syllable = buff.syllable;
+    wide.resize(pinyin.end - pinyin.beg);
+    wide.resize(utf8::decode_bulk(pinyin.beg, pinyin.end, &wide[0]));
 
-    std::wstring wide = utf8::decode(pinyin);
-    std::wstring ret;
     for (auto it = wide.begin(); it != wide.end(); ++it)
     {
         if (std::isspace(*it))
             continue;
 
-        std::wstring syllable;
+        syllable.clear();
         int tonepos = -1;
         for (; it != wide.end(); ++it)
         {
             const auto next_letter = *it;
             const auto prev_letter = syllable.empty() ? 0 : syllable.back();
-           // each syllable is terminated by a tone mark            
+           // each syllable is terminated by a tone mark
             if (std::isdigit(next_letter))
             {
                 const auto tone = next_letter - '0';
-                // the CEDIC dictionary format uses 5 tones but the 5th tone 
+                // the CEDIC dictionary format uses 5 tones but the 5th tone
                 // is the neutral tone and is simply represented by the "toneless" vowel
                 if (tone == 5)
                     break;
@@ -115,7 +204,7 @@ std::string make_dictionary_pinyin(std::string pinyin)
                     }
                 }
                 assert(tonepos >= 0);
-                assert(tonepos < syllable.size());
+                assert(tonepos < (int)syllable.size());
                 syllable[tonepos] = pinyin::tonemap(syllable[tonepos], tone);
                 break;
             }
@@ -150,111 +239,593 @@ std::string make_dictionary_pinyin(std::string pinyin)
                 }
             }
         }
-        ret.append(syllable);
+        utf8::encode(syllable.begin(), syllable.end(),
+            std::back_inserter(out));
         if (it == wide.end())
             break;
     }
-    return utf8::encode(ret);
 }
 
-std::string make_dictionary_definition(std::string s)
+void make_dictionary_definition(range def, std::string& out)
+{
+    assert(!def.empty() && def.end[-1] == '/');
+    const char* end = def.end - 1;
+
+    for (const char* pos = def.beg; pos != end; )
+    {
+        const char* slash = std::find(pos, end, '/');
+        out.append(pos, slash);
+        if (slash == end)
+            break;
+        out.append(" / ");
+        pos = slash + 1;
+    }
+}
+
+void process_chunk(chunk& c)
+{
+    buffers buff;
+
+    const char* pos = c.input.beg;
+    const char* end = c.input.end;
+
+    // validate all of the input up front so that the fields can be
+    // decoded without checking each of them separately.
+    const char* invalid = utf8::validate(pos, end);
+    if (invalid != end)
+    {
+        const char* line = pos;
+        for (const char* p = pos; p != invalid; ++p)
+        {
+            if (*p != '\n')
+                continue;
+            line = p + 1;
+            c.lines++;
+        }
+        c.error   = range{line, std::find(invalid, end, '\n')};
+        c.errline = c.lines + 1;
+        return;
+    }
+    while (pos != end)
+    {
+        const char* eol = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        if (eol == nullptr)
+            eol = end;
+
+        const char* line = pos;
+        const char* last = eol;
+        pos = eol == end ? end : eol + 1;
+        c.lines++;
+
+        if (line == last)
+            continue;
+        if (*line == '#')
+            continue;
+        if (last[-1] == '\r')
+            --last;
+
+        word w;
+        if (!parse_word(line, last, w) || w.definition.empty() || last[-1] != '/')
+        {
+            c.error   = range{line, last};
+            c.errline = c.lines;
+            return;
+        }
+
+        auto& out = c.output;
+        out.append(w.traditional.beg, w.traditional.end);
+        out.push_back('|');
+        out.append(w.simplified.beg, w.simplified.end);
+        out.push_back('|');
+        make_dictionary_pinyin(w.pinyin, buff, out);
+        out.push_back('|');
+        make_dictionary_definition(w.definition, out);
+        out.push_back('\n');
+        c.words++;
+    }
+}
+
+// split the input into roughly equal chunks at line boundaries.
+std::vector<chunk> make_chunks(const char* beg, const char* end, std::size_t count)
+{
+    std::vector<chunk> chunks;
+
+    const std::size_t bytes = end - beg;
+    const char* pos = beg;
+    for (std::size_t i=0; i<count && pos != end; ++i)
+    {
+        const char* next = end;
+        if (i + 1 < count)
+        {
+            next = pos + std::max<std::size_t>(bytes / count, 1);
+            if (next >= end)
+                next = end;
+            else
+            {
+                next = static_cast<const char*>(std::memchr(next, '\n', end - next));
+                next = next ? next + 1 : end;
+            }
+        }
+        chunk c;
+        c.input   = range{pos, next};
+        c.lines   = 0;
+        c.words   = 0;
+        c.error   = range{nullptr, nullptr};
+        c.errline = 0;
+        // a rough estimate, the output is about the same size as the input.
+        c.output.reserve(next - pos);
+        chunks.push_back(std::move(c));
+        pos = next;
+    }
+    return chunks;
+}
+
+void to_utf16(const char* beg, const char* end, std::u16string& out)
+{
+    out.resize(end - beg);
+    out.resize(utf8::decode_bulk(beg, end, &out[0]));
+}
+
+typedef std::unordered_map<std::string, std::uint32_t> freqmap;
+
+// the frequency tables that the application uses (see freqtable.cpp
+// and wordtable.cpp) and their checksums. the application keeps the
+// compiled frequencies only if the checksums match its own tables.
+struct tables {
+    freqmap chars;
+    freqmap words;
+    std::uint32_t char_table;
+    std::uint32_t word_table;
+};
+
+// call the function with the tab separated fields of each non empty
+// line the same way the application reads the table files.
+template<typename Function>
+void for_each_line(const range& data, Function function)
+{
+    const char* pos = data.beg;
+    const char* end = data.end;
+    if (end - pos >= 3 && !std::memcmp(pos, "\xEF\xBB\xBF", 3))
+        pos += 3;
+
+    std::vector<range> fields;
+    while (pos < end)
+    {
+        const char* eol = std::find(pos, end, '\n');
+        const char* next = eol == end ? end : eol + 1;
+        if (eol > pos && eol[-1] == '\r')
+            --eol;
+        if (eol != pos)
+        {
+            fields.clear();
+            for (const char* beg = pos; ; )
+            {
+                const char* tab = std::find(beg, eol, '\t');
+                fields.push_back(range{beg, tab});
+                if (tab == eol)
+                    break;
+                beg = tab + 1;
+            }
+            function(fields);
+        }
+        pos = next;
+    }
+}
+
+// parse a count like textfile::field::toLongLong does.
+bool parse_count(const range& r, long long& count)
+{
+    const char* p = r.beg;
+    bool negative = false;
+    if (p != r.end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == r.end)
+        return false;
+    count = 0;
+    for (; p != r.end; ++p)
+    {
+        if (*p < '0' || *p > '9')
+            return false;
+        count = count * 10 + (*p - '0');
+    }
+    if (negative)
+        count = -count;
+    return true;
+}
+
+// load the character frequency table (see freqtable.cpp)
+bool load_frequencies(const std::string& file, tables& freq)
+{
+    input in;
+    if (!open_input(file, in))
+        return false;
+
+    for_each_line(in.data, [&](const std::vector<range>& fields) {
+        long long count = 0;
+        if (fields.size() != 2 || !parse_count(fields[1], count))
+            return;
+        freq.chars[std::string(fields[0].beg, fields[0].end)] = count;
+    });
+    freq.char_table = dicfile::checksum(in.data.beg, in.data.end - in.data.beg);
+    return true;
+}
+
+// load the word frequency table (see wordtable.cpp). the counts are
+// quantized the same way as the application does so that the compiled
+// frequencies are the same that it would compute itself.
+bool load_words(const std::string& file, tables& freq)
+{
+    input in;
+    if (!open_input(file, in))
+        return false;
+
+    std::unordered_map<std::string, unsigned long long> counts;
+    for_each_line(in.data, [&](const std::vector<range>& fields) {
+        long long count = 0;
+        if (fields.size() == 2 && parse_count(fields[1], count))
+            counts[std::string(fields[0].beg, fields[0].end)] += count;
+    });
+    for (const auto& pair : counts)
+    {
+        const auto q = std::min<long>(std::lround(8.0 * std::log2(1.0 + pair.second)), 255);
+        freq.words[pair.first] = (std::uint32_t)std::lround(std::exp2(q / 8.0) - 1.0);
+    }
+    freq.word_table = dicfile::checksum(in.data.beg, in.data.end - in.data.beg);
+    return true;
+}
+
+// a line in the dictionary text format trad|simp|pinyin|definition
+struct entry {
+    range traditional;
+    range simplified;
+    range pinyin;
+    range definition;
+};
+
+bool split_entry(const char* beg, const char* end, entry& e)
+{
+    // the definition can contain '|' so only split on the first 3.
+    const char* sep1 = std::find(beg, end, '|');
+    if (sep1 == end)
+        return false;
+    const char* sep2 = std::find(sep1 + 1, end, '|');
+    if (sep2 == end)
+        return false;
+    const char* sep3 = std::find(sep2 + 1, end, '|');
+    if (sep3 == end)
+        return false;
+    e.traditional = range{beg, sep1};
+    e.simplified  = range{sep1 + 1, sep2};
+    e.pinyin      = range{sep2 + 1, sep3};
+    e.definition  = range{sep3 + 1, end};
+    return true;
+}
+
+// build the compiled dictionary (see dicfile.h) from the
+// converted dictionary lines in the chunks.
+std::string compile_chunks(const std::vector<chunk>& chunks, const tables& freq)
 {
-    assert(s.back() == '/');
-    s.pop_back();
+    dicfile::builder builder;
+
+    std::u16string trad, simp, pin, def, key;
+    std::string simplified;
 
-    std::string ret;
-    for (const auto& c : s)
+    for (const auto& c : chunks)
     {
-        if (c == '/')
+        const char* pos = c.output.data();
+        const char* end = pos + c.output.size();
+        while (pos != end)
         {
-            ret.append(" / ");
+            const char* eol = std::find(pos, end, '\n');
+            entry e;
+            split_entry(pos, eol, e);
+            to_utf16(e.traditional.beg, e.traditional.end, trad);
+            to_utf16(e.simplified.beg, e.simplified.end, simp);
+            to_utf16(e.pinyin.beg, e.pinyin.end, pin);
+            to_utf16(e.definition.beg, e.definition.end, def);
+
+            key.clear();
+            for (const auto c : pin)
+                key.push_back(pinyin::toneunmap(c));
+
+            // a single character comes from the character table and
+            // the longer words from the word table like in the application.
+            const auto& table = simp.size() > 1 ? freq.words : freq.chars;
+            std::uint32_t frequency = 0;
+            simplified.assign(e.simplified.beg, e.simplified.end);
+            const auto it = table.find(simplified);
+            if (it != std::end(table))
+                frequency = it->second;
+
+            builder.add(key, trad, simp, pin, def, frequency);
+            pos = eol + 1;
         }
-        else ret.push_back(c);
     }
-    return ret;
+    return builder.finish(freq.char_table, freq.word_table);
+}
+
+void from_utf16(const char16_t* beg, const char16_t* end, std::string& out)
+{
+    const auto size = out.size();
+    out.resize(size + (end - beg) * 3);
+    out.resize(size + utf8::encode_bulk(beg, end, &out[size]));
 }
 
-void process_word(word w, std::ostream& out)
+// read an existing dictionary in either the text or the compiled
+// format into the dictionary text format.
+bool load_dictionary(const std::string& file, std::string& text)
 {
-    const auto& key  = make_dictionary_key(w.pinyin);
-    const auto& pin  = make_dictionary_pinyin(w.pinyin);
-    const auto& def  = make_dictionary_definition(w.definition);
-    const auto& trad = w.traditional;
-    const auto& simp = w.simplified;
-
-    out << trad << "|" << simp << "|" << pin << "|" << def;
-    out << "\n";
+    input in;
+    if (!open_input(file, in))
+        return false;
+
+    const char* data = in.data.beg;
+    const std::size_t size = in.data.end - in.data.beg;
+    if (!size)
+        return true;
+    if (!dicfile::is_compiled(data, size))
+    {
+        text.assign(data, size);
+        return true;
+    }
+
+    const auto* head = dicfile::open(data, size);
+    if (!head)
+    {
+        std::cerr << "Unsupported dictionary file: " << file << "\n";
+        return false;
+    }
+    const auto* records = dicfile::records(head);
+    const auto* pool    = dicfile::pool(head);
+    for (std::uint32_t i=0; i<head->word_count; ++i)
+    {
+        const auto& rec = records[i];
+        const dicfile::string* fields[] = {
+            &rec.traditional, &rec.simplified, &rec.pinyin, &rec.definition
+        };
+        for (const auto* field : fields)
+        {
+            from_utf16(pool + field->offset, pool + field->offset + field->length, text);
+            text.push_back('|');
+        }
+        text.back() = '\n';
+    }
+    return true;
+}
+
+struct delta_stats {
+    std::size_t adds;
+    std::size_t removes;
+    std::size_t changes;
+};
+
+// compare the converted dictionary lines in the chunks against the
+// existing dictionary and produce a delta file. words are identified
+// by (traditional, simplified, pinyin). each line in the delta is the
+// operation followed by the word in the dictionary text format:
+//   +|trad|simp|pinyin|definition   new word
+//   -|trad|simp|pinyin|definition   removed word
+//   ~|trad|simp|pinyin|definition   changed definition
+// see dictionary::apply
+std::string diff_chunks(const std::vector<chunk>& chunks, const std::string& old, delta_stats& stats)
+{
+    typedef std::vector<std::string> definitions;
+    struct word_defs {
+        definitions before;
+        definitions after;
+    };
+    // keep the words in the order they appear in the new data
+    // so that the delta is stable and readable.
+    std::unordered_map<std::string, std::size_t> lookup;
+    std::vector<std::pair<std::string, word_defs>> words;
+
+    const auto collect = [&](const char* pos, const char* end, bool after) {
+        while (pos != end)
+        {
+            const char* eol = std::find(pos, end, '\n');
+            const char* next = eol == end ? end : eol + 1;
+            if (eol != pos && eol[-1] == '\r')
+                --eol;
+            entry e;
+            if (split_entry(pos, eol, e))
+            {
+                const std::string key(e.traditional.beg, e.pinyin.end);
+                const std::string def(e.definition.beg, e.definition.end);
+                auto it = lookup.find(key);
+                if (it == std::end(lookup))
+                {
+                    it = lookup.insert(std::make_pair(key, words.size())).first;
+                    words.push_back(std::make_pair(key, word_defs()));
+                }
+                auto& defs = words[it->second].second;
+                (after ? defs.after : defs.before).push_back(def);
+            }
+            pos = next;
+        }
+    };
+    for (const auto& c : chunks)
+        collect(c.output.data(), c.output.data() + c.output.size(), true);
+    collect(old.data(), old.data() + old.size(), false);
+
+    std::string out;
+    const auto emit = [&](char op, const std::string& key, const std::string& def) {
+        out.push_back(op);
+        out.push_back('|');
+        out.append(key);
+        out.push_back('|');
+        out.append(def);
+        out.push_back('\n');
+    };
+
+    stats = delta_stats{0, 0, 0};
+    for (const auto& word : words)
+    {
+        const auto& key  = word.first;
+        const auto& defs = word.second;
+        if (defs.before == defs.after)
+            continue;
+
+        // a single word with a new definition
+        if (defs.before.size() == 1 && defs.after.size() == 1)
+        {
+            emit('~', key, defs.after[0]);
+            stats.changes++;
+            continue;
+        }
+        for (const auto& def : defs.before)
+        {
+            if (std::find(defs.after.begin(), defs.after.end(), def) != defs.after.end())
+                continue;
+            emit('-', key, def);
+            stats.removes++;
+        }
+        for (const auto& def : defs.after)
+        {
+            if (std::find(defs.before.begin(), defs.before.end(), def) != defs.before.end())
+                continue;
+            emit('+', key, def);
+            stats.adds++;
+        }
+    }
+    return out;
 }
 
 int main(int argc, char* argv[])
 {
-    // simple ad-hoc test cases
-    // std::cout << make_dictionary_pinyin("huo3 guo3") << "\n";
-    // std::cout << make_dictionary_pinyin("chao3") << "\n";
-    // std::cout << make_dictionary_pinyin("chao2") << "\n";   
-    // std::cout << make_dictionary_pinyin("mei3 guo2") << "\n";
-    // std::cout << make_dictionary_pinyin("ma") << "\n";
-    // std::cout << make_dictionary_pinyin("ma3") << "\n";
-    // std::cout << make_dictionary_pinyin("ma5") << "\n";
-    // std::cout << make_dictionary_pinyin("e3") << "\n";
-    // std::cout << make_dictionary_pinyin("e5") << "\n";    
-    // return 0;
-
-    if (argc < 3)
+    // with -c the output is the compiled dictionary that the application
+    // can use as is. the optional character and word frequency files
+    // are joined into the words.
+    // with -d the output is the delta between the input and an existing
+    // dictionary that can be applied to it with dictionary::apply
+    std::string mode;
+    if (argc > 1 && argv[1][0] == '-')
+    {
+        mode = argv[1];
+        --argc;
+        ++argv;
+    }
+    const bool compile = mode == "-c";
+    const bool delta   = mode == "-d";
+
+    if (argc < 3 || (delta && argc < 4) || !(mode.empty() || compile || delta))
     {
         std::cerr << "Incorrect parameters\n";
         std::cerr << "cedict input-file output-file\n";
+        std::cerr << "cedict -c input-file output-file [frequency-file [words-file]]\n";
+        std::cerr << "cedict -d input-file output-file dictionary-file\n";
         return 1;
     }
 
-    std::string input = argv[1];
-    std::ifstream in(input, std::ios::binary);
-    if (!in.is_open())
+    tables freq {};
+    if (compile && argc > 3)
     {
-        std::cerr << "Failed to open: " << input;
-        return 1;
+        if (!load_frequencies(argv[3], freq))
+            return 1;
+    }
+    if (compile && argc > 4)
+    {
+        if (!load_words(argv[4], freq))
+            return 1;
     }
 
-    std::string output = argv[2];
-    std::ofstream out(output, std::ios::binary | std::ios::trunc);
-    if (!out.is_open())
+    std::string old;
+    if (delta)
     {
-        std::cerr << "Failed to open: " << output;
-        return 1;
+        if (!load_dictionary(argv[3], old))
+            return 1;
     }
 
+    input in;
+    if (!open_input(argv[1], in))
+        return 1;
 
-    std::string line;
-    std::size_t lineno = 0;
-    std::size_t wordno = 0;
-    while (!in.eof())
+    // write to a temporary file next to the output and replace the
+    // output only once everything has been written. a bad input then
+    // leaves the previous output as it was, and the application that
+    // has the old file mapped keeps its pages.
+    const std::string output = argv[2];
+    std::random_device random;
+    const std::string temp = output + "." + std::to_string(random()) + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
     {
-        std::getline(in, line);
-        lineno++;
-        if (!(lineno % 100))
+        std::cerr << "Failed to open: " << temp << "\n";
+        return 1;
+    }
+    struct cleanup {
+        const std::string& file;
+        bool done;
+       ~cleanup()
         {
-            std::cout << "\rAt line " << lineno;
-            std::cout.flush();
+            if (!done)
+                std::remove(file.c_str());
         }
+    } guard { temp, false };
 
-        if (line.empty())
-            continue;
-        if (line[0] == '#')
-            continue;
+    const char* beg = in.data.beg;
+    const char* end = in.data.end;
 
-        if (line.back() == '\r')
-            line.pop_back();
+    const auto threads = std::max(1u, std::thread::hardware_concurrency());
+    auto chunks = make_chunks(beg, end, threads);
 
-        word w;
-        if (!parse_word(line, w))
+    std::vector<std::thread> workers;
+    for (std::size_t i=1; i<chunks.size(); ++i)
+        workers.emplace_back(process_chunk, std::ref(chunks[i]));
+
+    // the calling thread takes the first chunk
+    if (!chunks.empty())
+        process_chunk(chunks[0]);
+
+    for (auto& t : workers)
+        t.join();
+
+    std::size_t lineno = 0;
+    std::size_t wordno = 0;
+    for (const auto& c : chunks)
+    {
+        if (c.error.beg)
         {
-            std::cerr << "Failed to parse: " << line;
+            std::cerr << "Failed to parse line " << lineno + c.errline << ": ";
+            std::cerr.write(c.error.beg, c.error.end - c.error.beg);
+            std::cerr << "\n";
             return 1;
         }
-        process_word(std::move(w), out);
-        wordno++;
+        if (mode.empty())
+            out.write(c.output.data(), c.output.size());
+        lineno += c.lines;
+        wordno += c.words;
+    }
+    if (compile)
+    {
+        const auto& image = compile_chunks(chunks, freq);
+        out.write(image.data(), image.size());
+    }
+    else if (delta)
+    {
+        delta_stats stats;
+        const auto& diff = diff_chunks(chunks, old, stats);
+        out.write(diff.data(), diff.size());
+        std::cout << stats.adds << " added, " << stats.removes << " removed, "
+                  << stats.changes << " changed\n";
     }
 
-    std::cout << "\rDone with " << wordno << " words!\n";
+    out.close();
+    if (!out.good())
+    {
+        std::cerr << "Failed to write: " << temp << "\n";
+        return 1;
+    }
+#if defined(_WIN32)
+    // rename doesn't replace an existing file on windows.
+    std::remove(output.c_str());
+#endif
+    if (std::rename(temp.c_str(), output.c_str()))
+    {
+        std::cerr << "Failed to replace: " << output << "\n";
+        return 1;
+    }
+    guard.done = true;
+
+    std::cout << "Done with " << wordno << " words!\n";
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,184 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+// benchmark how the dictionary reads scale with the number of reader
+// threads while a writer keeps storing words. the readers look up,
+// search and flatten the current version in a loop and the writer
+// stores a copy of a random word every millisecond so the readers
+// keep getting new versions, and the first search of each new
+// version builds the gram index of the modified layer again.
+// the benchmark fails (exits with 2) when the reads with up to as
+// many readers as there are cores don't scale to at least half of
+// the ideal speedup, e.g. 2x with 4 readers.
+//
+// usage: dictionary-stress dictionary-file [seconds-per-run]
+
+#include "../config.h"
+#include "../warnpush.h"
+#  include <QCoreApplication>
+#  include <QStringList>
+#  include <QtGlobal>
+#include "../warnpop.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../dictionary.h"
+
+namespace {
+    // the dictionary logs every stored word.
+    void quiet(QtMsgType, const char*)
+    {}
+
+    struct sample {
+        QString key;
+        QString hanzi;
+    };
+
+    // run the readers and the writer for the given time and
+    // return the number of reads done by all of the readers.
+    quint64 run(pime::dictionary& dic, const std::vector<sample>& samples,
+        const std::vector<pime::dictionary::word>& words, unsigned readers, int seconds)
+    {
+        std::atomic<bool> done(false);
+        std::atomic<quint64> reads(0);
+
+        std::vector<std::thread> threads;
+        for (unsigned i=0; i<readers; ++i)
+        {
+            threads.emplace_back([&, i]() {
+                std::mt19937 random(i);
+                quint64 count = 0;
+                while (!done)
+                {
+                    const auto& s = samples[random() % samples.size()];
+                    const auto version = dic.current();
+                    version->lookup(s.key);
+                    version->search(s.hanzi);
+                    if (++count % 1024 == 0)
+                        version->flatten();
+                }
+                reads += count;
+            });
+        }
+
+        std::thread writer([&]() {
+            std::mt19937 random(readers);
+            while (!done)
+            {
+                auto word = words[random() % words.size()];
+                dic.store(word);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        done = true;
+        writer.join();
+        for (auto& t : threads)
+            t.join();
+        return reads;
+    }
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    qInstallMsgHandler(quiet);
+
+    const auto& args = app.arguments();
+    if (args.size() < 2)
+    {
+        std::cerr << "usage: dictionary-stress dictionary-file [seconds-per-run]" << std::endl;
+        return 1;
+    }
+    const int seconds = args.size() > 2 ? args[2].toInt() : 5;
+
+    pime::dictionary dic;
+    try
+    {
+        dic.load(args[1], 2);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<sample> samples;
+    std::vector<pime::dictionary::word> words;
+    for (const auto* word : dic.flatten())
+    {
+        if (word->simplified.isEmpty())
+            continue;
+        samples.push_back(sample{word->key, word->simplified.left(2)});
+        pime::dictionary::word copy;
+        copy.traditional = word->traditional;
+        copy.simplified  = word->simplified;
+        copy.pinyin      = word->pinyin;
+        copy.description = dic.description(*word);
+        copy.definition  = pime::dictionary::word::NoDefinition;
+        copy.meta        = 1;
+        copy.guid        = 0;
+        copy.erased      = false;
+        copy.frequency   = 0;
+        words.push_back(copy);
+    }
+    if (samples.empty())
+    {
+        std::cerr << "no words in " << args[1].toUtf8().constData() << std::endl;
+        return 1;
+    }
+    std::cout << "words: " << samples.size() << std::endl;
+
+    const auto cores = std::max(1u, std::thread::hardware_concurrency());
+    double base = 0;
+    bool scales = true;
+    for (unsigned readers=1; readers<=cores * 2; readers *= 2)
+    {
+        const auto reads = run(dic, samples, words, readers, seconds);
+        const double rate = double(reads) / seconds;
+        if (readers == 1)
+            base = rate;
+        const double speedup = base ? rate / base : 0;
+        // more readers than cores can't go any faster.
+        const bool slow = readers <= cores && speedup < 0.5 * readers;
+        if (slow)
+            scales = false;
+        std::cout << "readers: " << readers
+                  << " reads/s: " << quint64(rate)
+                  << " per reader: " << quint64(rate / readers)
+                  << " speedup: " << speedup
+                  << (slow ? " FAILED" : "") << std::endl;
+    }
+    std::cout << "words stored: " << dic.wordCount() - samples.size() << std::endl;
+    if (!scales)
+    {
+        std::cerr << "the reads don't scale with the readers" << std::endl;
+        return 2;
+    }
+    return 0;
+}
\ No newline at end of file
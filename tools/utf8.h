@@ -1,4 +1,4 @@
-// Copyright (c) 2010-2013 Sami Väisänen, Ensisoft 
+// Copyright (c) 2010-2013 Sami Väisänen, Ensisoft
 //
 // http://www.ensisoft.com
 //
@@ -25,15 +25,31 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <iterator>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define UTF8_SSE2
+#  include <emmintrin.h>
+#endif
+
+// Wide strings are either UTF-16 (wchar_t on windows, char16_t) or
+// UTF-32 (wchar_t on linux, char32_t) depending on the size of the
+// character type. Characters outside the basic multilingual plane
+// (for example CJK Extension B) are encoded as surrogate pairs in UTF-16.
+//
+// The iterator based functions work with any iterators. The bulk
+// functions work on preallocated buffers and process runs of ASCII
+// 16 bytes at a time when SSE2 is available.
 
 namespace utf8
 {
     namespace detail {
         template<typename T>
         struct integer_type;
-        
+
         template<>
         struct integer_type<int>
         {
@@ -45,13 +61,13 @@ namespace utf8
         {
             typedef unsigned long unsigned_type;
         };
-        
+
         template<>
         struct integer_type<unsigned long>
         {
             typedef unsigned long unsigned_type;
         };
-        
+
         template<>
         struct integer_type<unsigned int>
         {
@@ -66,61 +82,312 @@ namespace utf8
         template<>
         struct integer_type<wchar_t>
         {
-            //typedef unsigned wchar_t unsigned_type;
-            typedef unsigned short unsigned_type;
+            // wchar_t is 16 bits on windows and 32 bits on linux
+            typedef std::conditional<sizeof(wchar_t) == 2,
+                std::uint16_t, std::uint32_t>::type unsigned_type;
         };
-    };
-
-    // encode the range specified by beg and end iterators 
-    // as an utf8 encoded byte stream into the output iterator dest.
-    template<typename InputIterator, typename OutputIterator>
-    void encode(InputIterator beg, InputIterator end, OutputIterator dest)
-    {
-        typedef typename std::iterator_traits<InputIterator>::value_type value_type;
-        typedef typename detail::integer_type<value_type>::unsigned_type unsigned_type;
-
-        // Unicode conversion table
-        // number range (4 bytes)| binary representation (octets) 
-        // -----------------------------------------------------------
-        // 0000 0000 - 0000 007F | 0xxxxxxx                 (US-ASCII) 
-        // 0000 0080 - 0000 07FF | 110xxxxx 10xxxxxx
-        // 0000 0800 - 0000 FFFF | 1110xxxx 10xxxxxx 10xxxxxx
-        // 0001 0000 - 0010 FFFF | 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
-        while (beg != end)
+        template<>
+        struct integer_type<char16_t>
         {
-            // maximum size for a Unicode character is 4 bytes
-            const uint32_t wchar = static_cast<unsigned_type>(*beg++);
+            typedef std::uint16_t unsigned_type;
+        };
+        template<>
+        struct integer_type<char32_t>
+        {
+            typedef std::uint32_t unsigned_type;
+        };
+
+        inline bool is_high_surrogate(std::uint32_t c)
+        { return c >= 0xD800 && c <= 0xDBFF; }
 
-            if (wchar <= 0x007F)
+        inline bool is_low_surrogate(std::uint32_t c)
+        { return c >= 0xDC00 && c <= 0xDFFF; }
+
+        // write a single code point as UTF-8.
+        template<typename OutputIterator>
+        OutputIterator put_utf8(std::uint32_t code, OutputIterator dest)
+        {
+            // Unicode conversion table
+            // number range (4 bytes)| binary representation (octets)
+            // -----------------------------------------------------------
+            // 0000 0000 - 0000 007F | 0xxxxxxx                 (US-ASCII)
+            // 0000 0080 - 0000 07FF | 110xxxxx 10xxxxxx
+            // 0000 0800 - 0000 FFFF | 1110xxxx 10xxxxxx 10xxxxxx
+            // 0001 0000 - 0010 FFFF | 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
+            if (code <= 0x007F)
             {
-                *dest++ = static_cast<char>(wchar);
+                *dest++ = static_cast<char>(code);
             }
-            else if (wchar >= 0x0080 &&  wchar <= 0x07FF)
+            else if (code <= 0x07FF)
             {
-                *dest++ = static_cast<char>((wchar >> 6)   | 0xC0);
-                *dest++ = static_cast<char>((wchar & 0x3F) | 0x80);
+                *dest++ = static_cast<char>((code >> 6)   | 0xC0);
+                *dest++ = static_cast<char>((code & 0x3F) | 0x80);
             }
-            else if (wchar >= 0x0800 && wchar <= 0xFFFF)
+            else if (code <= 0xFFFF)
             {
-                *dest++ = static_cast<char>((wchar >> 12)  | 0xE0);
-                *dest++ = static_cast<char>(((wchar >> 6)  & 0x3F) | 0x80);
-                *dest++ = static_cast<char>((wchar & 0x3F) | 0x80);
+                *dest++ = static_cast<char>((code >> 12)  | 0xE0);
+                *dest++ = static_cast<char>(((code >> 6)  & 0x3F) | 0x80);
+                *dest++ = static_cast<char>((code & 0x3F) | 0x80);
             }
             else
             {
-                *dest++ = static_cast<char>((wchar >> 18) | 0xF0);
-                *dest++ = static_cast<char>(((wchar >> 12) & 0x3F) | 0x80);
-                *dest++ = static_cast<char>(((wchar >>  6) & 0x3F) | 0x80);
-                *dest++ = static_cast<char>((wchar & 0x3F) | 0x80);
+                *dest++ = static_cast<char>((code >> 18) | 0xF0);
+                *dest++ = static_cast<char>(((code >> 12) & 0x3F) | 0x80);
+                *dest++ = static_cast<char>(((code >>  6) & 0x3F) | 0x80);
+                *dest++ = static_cast<char>((code & 0x3F) | 0x80);
+            }
+            return dest;
+        }
+
+        // write a single code point as UTF-16 or UTF-32.
+        template<typename WideChar, typename OutputIterator>
+        OutputIterator put_wide(std::uint32_t code, OutputIterator dest)
+        {
+            static_assert(sizeof(WideChar) >= 2, "wide character type is too narrow");
+
+            if (sizeof(WideChar) == 2 && code > 0xFFFF)
+            {
+                code -= 0x10000;
+                *dest++ = static_cast<WideChar>(0xD800 + (code >> 10));
+                *dest++ = static_cast<WideChar>(0xDC00 + (code & 0x3FF));
+            }
+            else *dest++ = static_cast<WideChar>(code);
+            return dest;
+        }
+
+        // read one character from UTF-16 or UTF-32 input. surrogate pairs are
+        // combined and unpaired surrogates are replaced with U+FFFD.
+        template<typename InputIterator>
+        std::uint32_t get_wide(InputIterator& beg, InputIterator end)
+        {
+            typedef typename std::iterator_traits<InputIterator>::value_type value_type;
+            typedef typename integer_type<value_type>::unsigned_type unsigned_type;
+
+            const std::uint32_t code = static_cast<unsigned_type>(*beg++);
+            if (is_high_surrogate(code))
+            {
+                if (beg == end)
+                    return 0xFFFD;
+                const std::uint32_t low = static_cast<unsigned_type>(*beg);
+                if (!is_low_surrogate(low))
+                    return 0xFFFD;
+                ++beg;
+                return 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (is_low_surrogate(code))
+                return 0xFFFD;
+            return code;
+        }
+
+        // read one (possibly multibyte) UTF-8 sequence starting at beg.
+        // returns false if the sequence is invalid or truncated, i.e. it's
+        // an overlong encoding, a surrogate or outside the unicode range.
+        template<typename InputIterator>
+        bool get_utf8(InputIterator& beg, InputIterator end, std::uint32_t& code)
+        {
+            const std::uint8_t lead = static_cast<std::uint8_t>(*beg);
+            std::uint32_t min = 0;
+            int more = 0;
+            if (lead < 0x80)
+            {
+                code = lead;
+                ++beg;
+                return true;
+            }
+            else if ((lead & 0xE0) == 0xC0)
+            {
+                code = lead & 0x1F;
+                more = 1;
+                min  = 0x80;
+            }
+            else if ((lead & 0xF0) == 0xE0)
+            {
+                code = lead & 0x0F;
+                more = 2;
+                min  = 0x800;
+            }
+            else if ((lead & 0xF8) == 0xF0)
+            {
+                code = lead & 0x07;
+                more = 3;
+                min  = 0x10000;
             }
+            else return false;
+
+            InputIterator pos = beg;
+            for (int i=0; i<more; ++i)
+            {
+                if (++pos == end)
+                    return false;
+                const std::uint8_t next = static_cast<std::uint8_t>(*pos);
+                if ((next & 0xC0) != 0x80)
+                    return false;
+                code = (code << 6) | (next & 0x3F);
+            }
+            if (code < min || code > 0x10FFFF)
+                return false;
+            if (code >= 0xD800 && code <= 0xDFFF)
+                return false;
+
+            beg = ++pos;
+            return true;
+        }
+
+        // find the end of the run of ASCII characters starting at beg.
+        inline const char* ascii_run(const char* beg, const char* end)
+        {
+#if defined(UTF8_SSE2)
+            while (end - beg >= 16)
+            {
+                const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(beg));
+                const int mask = _mm_movemask_epi8(bytes);
+                if (mask)
+                {
+                    // the lowest set bit is the first non-ascii byte
+                    int i = 0;
+                    while (!(mask & (1 << i)))
+                        ++i;
+                    return beg + i;
+                }
+                beg += 16;
+            }
+#else
+            while (end - beg >= 8)
+            {
+                std::uint64_t bytes;
+                std::memcpy(&bytes, beg, sizeof(bytes));
+                if (bytes & 0x8080808080808080ull)
+                    break;
+                beg += 8;
+            }
+#endif
+            while (beg != end && !(*beg & 0x80))
+                ++beg;
+            return beg;
+        }
+
+        // widen a run of ASCII characters into the output buffer.
+        template<typename WideChar>
+        WideChar* widen_ascii(const char* beg, const char* end, WideChar* out)
+        {
+#if defined(UTF8_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            for (; end - beg >= 16; beg += 16)
+            {
+                const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(beg));
+                const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+                const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+                if (sizeof(WideChar) == 2)
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 0), lo);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), hi);
+                }
+                else
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 0),  _mm_unpacklo_epi16(lo, zero));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4),  _mm_unpackhi_epi16(lo, zero));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8),  _mm_unpacklo_epi16(hi, zero));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_unpackhi_epi16(hi, zero));
+                }
+                out += 16;
+            }
+#endif
+            for (; beg != end; ++beg)
+                *out++ = static_cast<WideChar>(*beg);
+            return out;
+        }
+
+        // find the end of the run of ASCII characters in the wide string.
+        template<typename WideChar>
+        const WideChar* ascii_run(const WideChar* beg, const WideChar* end)
+        {
+            typedef typename integer_type<WideChar>::unsigned_type unsigned_type;
+#if defined(UTF8_SSE2)
+            if (sizeof(WideChar) == 2)
+            {
+                const __m128i high = _mm_set1_epi16(static_cast<short>(0xFF80));
+                const __m128i zero = _mm_setzero_si128();
+                for (; end - beg >= 8; beg += 8)
+                {
+                    const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(beg));
+                    const __m128i test  = _mm_cmpeq_epi16(_mm_and_si128(units, high), zero);
+                    if (_mm_movemask_epi8(test) != 0xFFFF)
+                        break;
+                }
+            }
+#endif
+            while (beg != end && static_cast<unsigned_type>(*beg) < 0x80)
+                ++beg;
+            return beg;
+        }
+
+        // narrow a run of ASCII wide characters into the output buffer.
+        template<typename WideChar>
+        char* narrow_ascii(const WideChar* beg, const WideChar* end, char* out)
+        {
+#if defined(UTF8_SSE2)
+            if (sizeof(WideChar) == 2)
+            {
+                for (; end - beg >= 8; beg += 8)
+                {
+                    const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(beg));
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(units, units));
+                    out += 8;
+                }
+            }
+#endif
+            for (; beg != end; ++beg)
+                *out++ = static_cast<char>(*beg);
+            return out;
+        }
+    } // detail
+
+    // encode the range specified by beg and end iterators
+    // as an utf8 encoded byte stream into the output iterator dest.
+    // 16 bit input is taken to be UTF-16 and surrogate pairs are
+    // combined into a single character. unpaired surrogates are
+    // replaced with U+FFFD.
+    template<typename InputIterator, typename OutputIterator>
+    void encode(InputIterator beg, InputIterator end, OutputIterator dest)
+    {
+        while (beg != end)
+        {
+            // maximum size for a Unicode character is 4 bytes
+            const std::uint32_t code = detail::get_wide(beg, end);
+            dest = detail::put_utf8(code, dest);
         } // while
     }
 
+    // encode the wide characters in the buffer into UTF-8 in the output buffer.
+    // the output buffer must have room for 3 bytes per UTF-16 or 4 bytes per
+    // UTF-32 input character. returns the number of bytes written.
+    template<typename WideChar>
+    std::size_t encode_bulk(const WideChar* beg, const WideChar* end, char* out)
+    {
+        typedef typename detail::integer_type<WideChar>::unsigned_type unsigned_type;
+
+        char* pos = out;
+        while (beg != end)
+        {
+            const WideChar* ascii = detail::ascii_run(beg, end);
+            pos = detail::narrow_ascii(beg, ascii, pos);
+            beg = ascii;
+
+            // encode the following non-ascii characters one at a time
+            while (beg != end && static_cast<unsigned_type>(*beg) >= 0x80)
+            {
+                const std::uint32_t code = detail::get_wide(beg, end);
+                pos = detail::put_utf8(code, pos);
+            }
+        }
+        return pos - out;
+    }
+
     // convenience function to encode (extended) ascii string to utf8
     inline std::string encode(const std::string& ascii)
     {
         std::string utf8;
-        encode(ascii.begin(), ascii.end(), 
+        encode(ascii.begin(), ascii.end(),
             std::back_inserter(utf8));
         return utf8;
     }
@@ -129,83 +396,85 @@ namespace utf8
     inline std::string encode(const std::wstring& unicode)
     {
         std::string utf8;
-        encode(unicode.begin(), unicode.end(),
-            std::back_inserter(utf8));
+        utf8.resize(unicode.size() * 4);
+        const auto* beg = unicode.data();
+        const auto bytes = encode_bulk(beg, beg + unicode.size(), &utf8[0]);
+        utf8.resize(bytes);
         return utf8;
     }
-    
 
+    // decode the utf8 encoded byte stream in the range specified by beg and end
+    // into wide characters in the output iterator dest. returns the position where
+    // decoding stopped which is end if all of the input was valid utf8.
     template<typename WideChar, typename InputIterator, typename OutputIterator>
     InputIterator decode(InputIterator beg, InputIterator end, OutputIterator dest)
     {
-        //typedef typename std::iterator_traits<OutputIterator>::value_type wide_t;
-        typedef WideChar wide_t;
-
-        InputIterator pos;
-
         while (beg != end)
         {
-            pos = beg;
-            wide_t wide = 0;
-            switch (*beg & 0xF0)
-            { 
-                case 0xF0: // 4 byte sequence
-                    if (sizeof(wide_t) < 4)
-                        return pos;
-                    wide |= wide_t(0x03 & *beg) << 3;
-                    for (int i=2; i>=0; --i)
-                    {
-                        if (++beg == end)
-                            return pos;
-                        wide |= wide_t(0x3F & *beg) << i*6;
-                    }
-                    *dest++ = wide;
-                    break;
+            std::uint32_t code = 0;
+            if (!detail::get_utf8(beg, end, code))
+                return beg;
+            dest = detail::put_wide<WideChar>(code, dest);
+        }
+        return beg;
+    }
 
-                case 0xE0: // 3 byte sequence (fits in 16 bits)
-                    if (sizeof(wide_t) < 2)
-                        return pos;
-                    wide |= wide_t(0x0F & *beg) << 12;
-                    if (++beg == end)
-                        return pos;
-                    wide |= wide_t(0x3F & *beg) << 6;
-                    if (++beg == end)
-                        return pos;
-                    wide |= 0x3F & *beg;
-                    *dest++ = wide;
-                    break;
+    // decode the utf8 encoded bytes into the output buffer that must have room
+    // for at least (end - beg) wide characters. returns the number of wide characters
+    // written. if error is not null it's set to the position where decoding stopped
+    // which is end if all of the input was valid utf8.
+    template<typename WideChar>
+    std::size_t decode_bulk(const char* beg, const char* end, WideChar* out, const char** error = nullptr)
+    {
+        WideChar* pos = out;
+        while (beg != end)
+        {
+            const char* ascii = detail::ascii_run(beg, end);
+            pos = detail::widen_ascii(beg, ascii, pos);
+            beg = ascii;
 
-                case 0xC0: // 2 byte sequence
-                case 0xD0:
-                    if (sizeof(wide_t) < 2)
-                        return pos;
-                    wide |= wide_t(0x1F & *beg) << 6;
-                    if (++beg == end)
-                        return pos;
-                    wide |= 0x3F & *beg;
-                    if (wide < 0x7F)
-                        return pos; // illegal sequence, multibyte but just ascii
-                    *dest++ = wide;
-                    break;
+            // decode the following non-ascii sequences one at a time
+            while (beg != end && (*beg & 0x80))
+            {
+                std::uint32_t code = 0;
+                if (!detail::get_utf8(beg, end, code))
+                {
+                    if (error)
+                        *error = beg;
+                    return pos - out;
+                }
+                pos = detail::put_wide<WideChar>(code, pos);
+            }
+        }
+        if (error)
+            *error = end;
+        return pos - out;
+    }
 
-                default:   // 1 byte sequnce (ascii)
-                    *dest++ = *beg;
-                    break;
+    // validate the utf8 encoded bytes. returns the position of the first
+    // invalid sequence or end if all of the input is valid.
+    inline const char* validate(const char* beg, const char* end)
+    {
+        while (beg != end)
+        {
+            beg = detail::ascii_run(beg, end);
+            while (beg != end && (*beg & 0x80))
+            {
+                std::uint32_t code = 0;
+                if (!detail::get_utf8(beg, end, code))
+                    return beg;
             }
-            ++beg;
         }
-        return beg;
+        return end;
     }
 
     inline std::wstring decode(const std::string& utf8)
     {
         std::wstring ret;
-        decode<wchar_t>(utf8.begin(), utf8.end(), 
-            std::back_inserter(ret));
+        ret.resize(utf8.size());
+        const auto* beg = utf8.data();
+        ret.resize(decode_bulk(beg, beg + utf8.size(), &ret[0]));
         return ret;
     }
 
 } // utf8
-
-
-
@@ -0,0 +1,223 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+// build the word frequency table (data/words.txt, see wordtable.cpp)
+// from a corpus of Chinese text. the text is segmented into the longest
+// words found in the dictionary and the words and the pairs of adjacent
+// words are counted. the words are counted by their simplified form
+// since that's what the application looks them up with.
+//
+// wordfreq [-m min-count] dictionary-file output-file corpus-file...
+// the dictionary is in the text format produced by cedict.
+
+#include "../config.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "utf8.h"
+
+typedef std::unordered_map<std::u16string, std::u16string> formmap;
+
+std::u16string to_utf16(const std::string& str)
+{
+    std::u16string ret;
+    ret.resize(str.size());
+    ret.resize(utf8::decode_bulk(str.data(), str.data() + str.size(), &ret[0]));
+    return ret;
+}
+
+std::string to_utf8(const std::u16string& str)
+{
+    std::string ret;
+    ret.resize(str.size() * 3);
+    ret.resize(utf8::encode_bulk(str.data(), str.data() + str.size(), &ret[0]));
+    return ret;
+}
+
+// map both the traditional and the simplified form of
+// every word to the simplified form.
+bool load_dictionary(const std::string& file, formmap& forms, std::size_t& longest)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open())
+    {
+        std::cerr << "Failed to open: " << file << "\n";
+        return false;
+    }
+    longest = 0;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        // trad|simp|pinyin|definition
+        const auto sep1 = line.find('|');
+        if (sep1 == std::string::npos)
+            continue;
+        const auto sep2 = line.find('|', sep1 + 1);
+        if (sep2 == std::string::npos)
+            continue;
+        const auto& trad = to_utf16(line.substr(0, sep1));
+        const auto& simp = to_utf16(line.substr(sep1 + 1, sep2 - sep1 - 1));
+        forms[trad] = simp;
+        forms[simp] = simp;
+        longest = std::max(longest, std::max(trad.size(), simp.size()));
+    }
+    return true;
+}
+
+struct counts {
+    std::unordered_map<std::u16string, std::uint64_t> unigrams;
+    std::map<std::pair<std::u16string, std::u16string>, std::uint64_t> bigrams;
+};
+
+// segment the line with the longest match. the text that isn't in the
+// dictionary breaks the chain of words so no pair is counted over it.
+void count_line(const std::u16string& line, const formmap& forms, std::size_t longest, counts& out)
+{
+    const std::u16string* previous = nullptr;
+    for (std::size_t i=0; i<line.size(); )
+    {
+        const std::u16string* match = nullptr;
+        std::size_t length = std::min(longest, line.size() - i);
+        for (; length > 0; --length)
+        {
+            const auto it = forms.find(line.substr(i, length));
+            if (it != std::end(forms))
+            {
+                match = &it->second;
+                break;
+            }
+        }
+        if (!match)
+        {
+            previous = nullptr;
+            ++i;
+            continue;
+        }
+        out.unigrams[*match]++;
+        if (previous)
+            out.bigrams[std::make_pair(*previous, *match)]++;
+        previous = match;
+        i += length;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::uint64_t min = 2;
+    if (argc > 2 && !std::strcmp(argv[1], "-m"))
+    {
+        min = std::strtoull(argv[2], nullptr, 10);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 4)
+    {
+        std::cerr << "Incorrect parameters\n";
+        std::cerr << "wordfreq [-m min-count] dictionary-file output-file corpus-file...\n";
+        return 1;
+    }
+
+    formmap forms;
+    std::size_t longest = 0;
+    if (!load_dictionary(argv[1], forms, longest))
+        return 1;
+
+    counts count;
+    std::string line;
+    for (int i=3; i<argc; ++i)
+    {
+        std::ifstream in(argv[i], std::ios::binary);
+        if (!in.is_open())
+        {
+            std::cerr << "Failed to open: " << argv[i] << "\n";
+            return 1;
+        }
+        while (std::getline(in, line))
+        {
+            const char* error = nullptr;
+            std::u16string wide;
+            wide.resize(line.size());
+            wide.resize(utf8::decode_bulk(line.data(), line.data() + line.size(), &wide[0], &error));
+            if (error != line.data() + line.size())
+            {
+                std::cerr << "Invalid UTF-8 in: " << argv[i] << "\n";
+                return 1;
+            }
+            count_line(wide, forms, longest, count);
+        }
+    }
+
+    // the rare words and pairs say little and only make the table bigger.
+    std::map<std::u16string, std::uint64_t> words;
+    for (const auto& u : count.unigrams)
+    {
+        if (u.second >= min)
+            words.insert(u);
+    }
+
+    const std::string output = argv[2];
+    const std::string temp = output + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        std::cerr << "Failed to open: " << temp << "\n";
+        return 1;
+    }
+    for (const auto& w : words)
+        out << to_utf8(w.first) << "\t" << w.second << "\n";
+
+    std::size_t pairs = 0;
+    for (const auto& b : count.bigrams)
+    {
+        if (b.second < min)
+            continue;
+        out << to_utf8(b.first.first) << "\t" << to_utf8(b.first.second) << "\t" << b.second << "\n";
+        ++pairs;
+    }
+    out.close();
+    if (!out.good())
+    {
+        std::remove(temp.c_str());
+        std::cerr << "Failed to write: " << temp << "\n";
+        return 1;
+    }
+#if defined(_WIN32)
+    std::remove(output.c_str());
+#endif
+    if (std::rename(temp.c_str(), output.c_str()))
+    {
+        std::remove(temp.c_str());
+        std::cerr << "Failed to replace: " << output << "\n";
+        return 1;
+    }
+
+    std::cout << "Done with " << words.size() << " words and " << pairs << " word pairs!\n";
+    return 0;
+}
@@ -0,0 +1,209 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QtDebug>
+#  include <QFile>
+#  include <QTextStream>
+#include "warnpop.h"
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#  include <psapi.h>
+#  pragma comment(lib, "psapi.lib")
+#else
+#  include <sys/resource.h>
+#endif
+
+#include "tracer.h"
+
+// the allocations are counted by replacing the global operator new.
+// the count is only updated while tracing so otherwise an allocation
+// costs a single relaxed load more. the threads don't need to agree
+// on the order of the updates, only on the total.
+namespace {
+    std::atomic<bool> counting(false);
+    std::atomic<quint64> allocations(0);
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    if (counting.load(std::memory_order_relaxed))
+        allocations.fetch_add(1, std::memory_order_relaxed);
+
+    for (;;)
+    {
+        if (void* p = std::malloc(size ? size : 1))
+            return p;
+        const auto handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void* p) throw()
+{
+    std::free(p);
+}
+
+namespace {
+
+// get the number of allocations made since the tracing was enabled.
+quint64 allocation_count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+// get the peak resident memory of the process in kilobytes
+quint64 peak_rss()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+  #if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+  #else
+    return usage.ru_maxrss;
+  #endif
+#endif
+}
+
+struct event {
+    const char* name;
+    qint64 start;
+    qint64 duration;
+    qint64 filesize;
+    quint64 allocations;
+    quint64 peakrss;
+};
+
+bool enabled;
+QString file;
+QElapsedTimer clock;
+std::vector<event> events;
+
+} // namespace
+
+namespace pime
+{
+
+tracer::phase::phase(const char* name) : name_(name), start_(0), fileSize_(0), allocations_(0)
+{
+    if (!enabled)
+        return;
+
+    start_ = clock.nsecsElapsed() / 1000;
+    allocations_ = allocation_count();
+}
+
+tracer::phase::~phase()
+{
+    if (!enabled)
+        return;
+
+    event e;
+    e.name        = name_;
+    e.start       = start_;
+    e.duration    = clock.nsecsElapsed() / 1000 - start_;
+    e.filesize    = fileSize_;
+    e.allocations = allocation_count() - allocations_;
+    e.peakrss     = peak_rss();
+    events.push_back(e);
+}
+
+void tracer::enable(const QString& report)
+{
+    enabled = true;
+    file    = report;
+    clock.start();
+    counting.store(true, std::memory_order_relaxed);
+}
+
+void tracer::finish()
+{
+    if (!enabled)
+        return;
+
+    enabled = false;
+    counting.store(false, std::memory_order_relaxed);
+
+    // the trace is only a diagnostic, failing to write it
+    // mustn't stop the application.
+    QFile io(file);
+    if (!io.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << "Failed to open trace file " << file;
+        events.clear();
+        return;
+    }
+
+    // the phases are nested so the events are sorted by their start
+    // time for the viewer to show them in order.
+    std::stable_sort(std::begin(events), std::end(events),
+        [](const event& lhs, const event& rhs) {
+            return lhs.start < rhs.start;
+        });
+
+    QTextStream stream(&io);
+    stream.setCodec("UTF-8");
+    stream << "{\"traceEvents\":[\n";
+    for (std::size_t i=0; i<events.size(); ++i)
+    {
+        const auto& e = events[i];
+        stream << "{\"name\":\"" << e.name << "\",\"cat\":\"startup\",\"ph\":\"X\","
+               << "\"pid\":1,\"tid\":1,"
+               << "\"ts\":" << e.start << ",\"dur\":" << e.duration << ","
+               << "\"args\":{\"file_size\":" << e.filesize
+               << ",\"allocations\":" << e.allocations
+               << ",\"peak_rss_kb\":" << e.peakrss << "}}";
+        if (i + 1 < events.size())
+            stream << ",";
+        stream << "\n";
+    }
+    stream << "],\"displayTimeUnit\":\"ms\"}\n";
+    stream.flush();
+    if (stream.status() != QTextStream::Ok)
+        qWarning() << "Failed to write trace file " << file;
+    else qDebug() << "Wrote startup trace " << file << " with " << events.size() << " phases";
+    events.clear();
+}
+
+bool tracer::isEnabled()
+{
+    return enabled;
+}
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,69 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#  include <QElapsedTimer>
+#include "warnpop.h"
+
+namespace pime
+{
+    // trace the phases of the application startup. when enabled each
+    // phase is recorded with its duration, the size of the file it
+    // loaded, the number of memory allocations (by all the threads)
+    // and the peak resident memory and the report is written as a
+    // Chrome trace (chrome://tracing) JSON file. tracing is meant
+    // for the main thread only.
+    class tracer
+    {
+    public:
+        class phase
+        {
+        public:
+            phase(const char* name);
+           ~phase();
+
+            // set the size of the file loaded during the phase.
+            void setFileSize(qint64 size)
+            { fileSize_ = size; }
+
+        private:
+            const char* name_;
+            qint64 start_;
+            qint64 fileSize_;
+            quint64 allocations_;
+        };
+
+        // start tracing and write the report to the given file.
+        static void enable(const QString& file);
+
+        // write the report if tracing is enabled. a failure
+        // to write it is only logged.
+        static void finish();
+
+        static bool isEnabled();
+    };
+
+} // pime
\ No newline at end of file
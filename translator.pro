@@ -6,23 +6,43 @@ QMAKE_CXXFLAGS += -std=c++11
 QMAKE_CXXFLAGS += -Wno-unused-parameter
 
 
-SOURCES = dictionary.cpp \
+SOURCES = converter.cpp \
+	dictionary.cpp \
 	dlgdictionary.cpp \
+	document.cpp \
 	freqtable.cpp \
 	main.cpp \
 	mainwindow.cpp \
-	qtmain_win.cpp
+	qtmain_win.cpp \
+	savefile.cpp \
+	textfile.cpp \
+	tracer.cpp \
+	transliterator.cpp \
+	trie.cpp \
+	usagetable.cpp \
+	wordtable.cpp
 
 HEADERS = config.h \
+	converter.h \
+	dicfile.h \
 	dictionary.h \
 	dlgdictionary.h \
 	dlgword.h \
+	document.h \
 	format.h \
 	freqtable.h \
 	mainwindow.h \
+	memusage.h \
 	pinyin.h \
+	savefile.h \
+	textfile.h \
+	tracer.h \
+	transliterator.h \
+	trie.h \
+	usagetable.h \
 	warnpop.h \
-	warnpush.h
+	warnpush.h \
+	wordtable.h
 	
 FORMS = mainwindow.ui \
 	dlgword.ui \
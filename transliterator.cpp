@@ -0,0 +1,228 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QtDebug>
+#  include <QTextStream>
+#include "warnpop.h"
+#include <algorithm>
+#include <map>
+
+#include "transliterator.h"
+
+namespace {
+    typedef std::map<QChar, std::vector<QString>> readingmap;
+
+    // split the pinyin of a word into the readings of its characters.
+    // the syllables aren't separated in the pinyin so the readings are
+    // matched against the known readings of the single characters.
+    bool segment(const QString& text, const QString& pinyin, const readingmap& readings,
+        int i, int pos, std::vector<QString>& ret)
+    {
+        if (i == text.size())
+            return pos == pinyin.size();
+
+        const auto it = readings.find(text[i]);
+        if (it == std::end(readings))
+            return false;
+        for (const auto& reading : it->second)
+        {
+            if (pinyin.mid(pos, reading.size()) != reading)
+                continue;
+            ret.push_back(reading);
+            if (segment(text, pinyin, readings, i + 1, pos + reading.size(), ret))
+                return true;
+            ret.pop_back();
+        }
+        return false;
+    }
+
+    QString normalize(const QString& pinyin)
+    {
+        QString ret = pinyin.toLower();
+        ret.remove(' ');
+        ret.remove('\'');
+        return ret;
+    }
+} // namespace
+
+namespace pime
+{
+
+transliterator::transliterator()
+{}
+
+transliterator::~transliterator()
+{}
+
+void transliterator::build(const dictionary::snapshot& words)
+{
+    std::vector<trie::entry> entries;
+    std::vector<const dictionary::word*> list;
+    for (const auto* word : words.flatten())
+    {
+        // skip the words that start with latin letters such as DNA
+        // so that they're not mangled in the middle of other text.
+        if (word->traditional.isEmpty() || word->traditional[0].unicode() < 0x2e80)
+            continue;
+        list.push_back(word);
+    }
+
+    // the readings of the single characters.
+    readingmap readings;
+    for (const auto* word : list)
+    {
+        if (word->traditional.size() != 1 || word->simplified.size() != 1)
+            continue;
+        const auto& reading = normalize(word->pinyin);
+        for (const auto c : { word->traditional[0], word->simplified[0] })
+        {
+            auto& known = readings[c];
+            if (std::find(std::begin(known), std::end(known), reading) == std::end(known))
+                known.push_back(reading);
+        }
+    }
+
+    // the readings of the characters in the longer words tell which
+    // reading of a character is the common one. a reading gets the
+    // frequencies of the words it's used in.
+    std::map<std::pair<QChar, QString>, quint64> support;
+    std::vector<QString> split;
+    for (const auto* word : list)
+    {
+        const auto& text = word->simplified;
+        if (text.size() < 2 || text.size() != word->traditional.size())
+            continue;
+        split.clear();
+        if (!segment(text, normalize(word->pinyin), readings, 0, 0, split))
+            continue;
+        for (int i=0; i<text.size(); ++i)
+        {
+            support[std::make_pair(text[i], split[i])] += 1 + word->frequency;
+            if (word->traditional[i] != text[i])
+                support[std::make_pair(word->traditional[i], split[i])] += 1 + word->frequency;
+        }
+    }
+    const auto supported = [&](const dictionary::word* w) -> quint64 {
+        if (w->traditional.size() != 1 || w->simplified.size() != 1)
+            return 0;
+        const auto& reading = normalize(w->pinyin);
+        quint64 ret = 0;
+        auto it = support.find(std::make_pair(w->simplified[0], reading));
+        if (it != std::end(support))
+            ret += it->second;
+        if (w->traditional != w->simplified)
+        {
+            it = support.find(std::make_pair(w->traditional[0], reading));
+            if (it != std::end(support))
+                ret += it->second;
+        }
+        return ret;
+    };
+    std::vector<quint64> score(list.size());
+    for (std::size_t i=0; i<list.size(); ++i)
+        score[i] = supported(list[i]);
+
+    // put the preferred reading of each word first. the readings of a
+    // single character have the same character frequency so they're
+    // told apart by how much they're used in the longer words. the
+    // capitalized readings are usually names so the common word goes
+    // before them. the positions are sorted so that the scores are
+    // simply indexed by the comparison.
+    const auto lower = [](const dictionary::word* w) {
+        return !w->pinyin.isEmpty() && w->pinyin[0].isLower();
+    };
+    std::vector<std::size_t> order(list.size());
+    for (std::size_t i=0; i<order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(std::begin(order), std::end(order),
+        [&](std::size_t l, std::size_t r) {
+            const auto* lhs = list[l];
+            const auto* rhs = list[r];
+            if (lhs->frequency != rhs->frequency)
+                return lhs->frequency > rhs->frequency;
+            if (score[l] != score[r])
+                return score[l] > score[r];
+            return lower(lhs) && !lower(rhs);
+        });
+
+    std::vector<const dictionary::word*> sorted;
+    sorted.reserve(list.size());
+    for (const auto i : order)
+        sorted.push_back(list[i]);
+    list.swap(sorted);
+
+    for (const auto* word : list)
+    {
+        entries.push_back(trie::entry{word->traditional, word->pinyin});
+        if (word->simplified != word->traditional)
+            entries.push_back(trie::entry{word->simplified, word->pinyin});
+    }
+    trie_.build(entries);
+
+    qDebug() << "Built transliteration trie with " << trie_.size()
+             << " words and " << trie_.nodeCount() << " nodes";
+}
+
+QString transliterator::transliterate(const QString& text) const
+{
+    QString ret;
+    ret.reserve(text.size() * 4);
+
+    const auto* data = text.constData();
+    const auto  size = text.size();
+
+    bool word = false;
+    for (int i=0; i<size; )
+    {
+        const QString* pinyin = nullptr;
+        const auto len = trie_.match(data + i, size - i, pinyin);
+        if (len == 0)
+        {
+            ret.append(data[i++]);
+            word = false;
+            continue;
+        }
+        if (word)
+            ret.append(' ');
+        ret.append(*pinyin);
+        word = true;
+        i += len;
+    }
+    return ret;
+}
+
+void transliterator::transliterate(QTextStream& in, QTextStream& out) const
+{
+    // the words never span lines so the input can be
+    // converted one line at a time.
+    while (!in.atEnd())
+    {
+        out << transliterate(in.readLine());
+        out << "\n";
+    }
+    out.flush();
+}
+
+} // pime
\ No newline at end of file
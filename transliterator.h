@@ -0,0 +1,67 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#include "warnpop.h"
+#include "dictionary.h"
+#include "trie.h"
+
+class QTextStream;
+
+namespace pime
+{
+    // convert Chinese text to toned pinyin. the text is segmented into
+    // the longest words found in the dictionary using a trie of the
+    // traditional and simplified forms of the words. when a word has
+    // several readings the most frequent one is used. the readings of
+    // a character are ranked by how much they're used in the frequent
+    // longer words.
+    class transliterator
+    {
+    public:
+        transliterator();
+       ~transliterator();
+
+        // build the trie from the words in the given dictionary version.
+        void build(const dictionary::snapshot& words);
+
+        // convert the text to pinyin. the words are separated by a space
+        // and any text that isn't found in the dictionary is copied as is.
+        QString transliterate(const QString& text) const;
+
+        // convert the input stream line by line to the output stream.
+        void transliterate(QTextStream& in, QTextStream& out) const;
+
+        // return the number of different words in the trie.
+        std::size_t wordCount() const
+        { return trie_.size(); }
+
+    private:
+        trie trie_;
+    };
+
+} // pime
\ No newline at end of file
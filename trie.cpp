@@ -0,0 +1,132 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "config.h"
+#include <algorithm>
+
+#include "trie.h"
+
+namespace pime
+{
+
+trie::trie()
+{}
+
+trie::~trie()
+{}
+
+void trie::build(std::vector<entry>& entries)
+{
+    // the stable sort keeps the preferred entry first.
+    std::stable_sort(std::begin(entries), std::end(entries),
+        [](const entry& lhs, const entry& rhs) {
+            return lhs.key < rhs.key;
+        });
+    entries.erase(std::unique(std::begin(entries), std::end(entries),
+        [](const entry& lhs, const entry& rhs) {
+            return lhs.key == rhs.key;
+        }), std::end(entries));
+
+    nodes_.clear();
+    values_.clear();
+    values_.reserve(entries.size());
+
+    node root;
+    root.first = 0;
+    root.count = 0;
+    root.value = NoValue;
+    nodes_.push_back(root);
+    build(entries, 0, entries.size(), 0, 0);
+}
+
+int trie::match(const QChar* text, int size, const QString*& value) const
+{
+    if (nodes_.empty())
+        return 0;
+
+    int ret = 0;
+    quint32 current = 0;
+    for (int i=0; i<size; ++i)
+    {
+        const auto& parent = nodes_[current];
+        const auto* beg = &nodes_[0] + parent.first;
+        const auto* end = beg + parent.count;
+        const auto* it = std::lower_bound(beg, end, text[i],
+            [](const node& n, QChar ch) {
+                return n.ch < ch;
+            });
+        if (it == end || it->ch != text[i])
+            break;
+
+        current = it - &nodes_[0];
+        if (it->value != NoValue)
+        {
+            value = &values_[it->value];
+            ret = i + 1;
+        }
+    }
+    return ret;
+}
+
+void trie::build(const std::vector<entry>& entries, std::size_t lo, std::size_t hi,
+    int depth, quint32 parent)
+{
+    // the entries are sorted so a key that ends at this depth
+    // comes before the longer keys with the same prefix.
+    if (lo < hi && entries[lo].key.size() == depth)
+    {
+        nodes_[parent].value = values_.size();
+        values_.push_back(entries[lo].value);
+        ++lo;
+    }
+
+    // allocate the children first so that they're next to each other.
+    std::vector<std::pair<std::size_t, std::size_t>> groups;
+    for (auto i = lo; i < hi; )
+    {
+        const auto ch = entries[i].key[depth];
+        auto j = i + 1;
+        while (j < hi && entries[j].key[depth] == ch)
+            ++j;
+        groups.push_back(std::make_pair(i, j));
+        i = j;
+    }
+    nodes_[parent].first = nodes_.size();
+    nodes_[parent].count = groups.size();
+    for (const auto& group : groups)
+    {
+        node child;
+        child.ch    = entries[group.first].key[depth];
+        child.first = 0;
+        child.count = 0;
+        child.value = NoValue;
+        nodes_.push_back(child);
+    }
+    for (std::size_t i=0; i<groups.size(); ++i)
+    {
+        const auto child = nodes_[parent].first + i;
+        build(entries, groups[i].first, groups[i].second, depth + 1, child);
+    }
+}
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,81 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#include "warnpop.h"
+#include <vector>
+
+namespace pime
+{
+    // map the strings of Chinese text to values for segmenting text
+    // into the longest known words. the children of a node are stored
+    // next to each other sorted by their character so a step down the
+    // trie is a binary search in a small array.
+    class trie
+    {
+    public:
+        struct entry {
+            QString key;
+            QString value;
+        };
+
+        trie();
+       ~trie();
+
+        // build the trie from the entries. when there are several
+        // entries with the same key the first one is used.
+        void build(std::vector<entry>& entries);
+
+        // find the longest key that starts at the given text.
+        // returns the length of the key or 0 if there's none.
+        int match(const QChar* text, int size, const QString*& value) const;
+
+        // return the number of keys in the trie.
+        std::size_t size() const
+        { return values_.size(); }
+
+        std::size_t nodeCount() const
+        { return nodes_.size(); }
+
+    private:
+        enum : quint32 { NoValue = 0xffffffff };
+
+        struct node {
+            QChar ch;
+            quint32 first;
+            quint32 count;
+            quint32 value;
+        };
+        void build(const std::vector<entry>& entries, std::size_t lo, std::size_t hi,
+            int depth, quint32 parent);
+
+    private:
+        std::vector<node> nodes_;
+        std::vector<QString> values_;
+    };
+
+} // pime
\ No newline at end of file
@@ -0,0 +1,137 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QtDebug>
+#  include <QTextStream>
+#include "warnpop.h"
+#include <stdexcept>
+
+#include "usagetable.h"
+#include "savefile.h"
+#include "textfile.h"
+#include "format.h"
+
+// the usage data is stored one word per line as
+// key|traditional|simplified|pinyin|count
+
+namespace pime
+{
+
+usagetable::usagetable() : count_(0), generation_(0)
+{}
+
+usagetable::~usagetable()
+{}
+
+void usagetable::load(const QString& file)
+{
+    // a bad line, such as the end of an interrupted write, only
+    // loses the counts on that line and not the whole history.
+    std::size_t skipped = 0;
+
+    textfile text(file);
+    while (text.next())
+    {
+        textfile::field toks[5];
+        bool ok = text.fields('|') == 5 && text.split('|', toks, 5);
+        const auto count = ok ? toks[4].toLongLong(&ok) : 0;
+        if (!ok || count < 0 || toks[0].isEmpty())
+        {
+            qWarning() << text.error("unexpected usage table data").what();
+            ++skipped;
+            continue;
+        }
+
+        usage u;
+        u.traditional = toks[1].toString();
+        u.simplified  = toks[2].toString();
+        u.pinyin      = toks[3].toString();
+        u.count       = count;
+        table_[toks[0].toString()].push_back(u);
+        ++count_;
+    }
+    if (skipped)
+        qWarning() << "Skipped " << skipped << " bad lines in " << file;
+}
+
+void usagetable::save(const QString& file) const
+{
+    savefile io(file);
+
+    QTextStream stream(io.device());
+    stream.setCodec("UTF-8");
+    for (const auto& pair : table_)
+    {
+        for (const auto& u : pair.second)
+        {
+            stream << pair.first << "|" << u.traditional << "|" << u.simplified << "|" << u.pinyin << "|" << u.count;
+            stream << "\n";
+        }
+    }
+    stream.flush();
+    if (stream.status() != QTextStream::Ok)
+        throw std::runtime_error(utf8("save usage table failed: _1", file));
+
+    io.commit();
+}
+
+quint32 usagetable::record(const dictionary::word& word)
+{
+    ++generation_;
+
+    auto& list = table_[word.key];
+    for (auto& u : list)
+    {
+        if (u.traditional == word.traditional &&
+            u.simplified == word.simplified &&
+            u.pinyin == word.pinyin)
+            return ++u.count;
+    }
+    usage u;
+    u.traditional = word.traditional;
+    u.simplified  = word.simplified;
+    u.pinyin      = word.pinyin;
+    u.count       = 1;
+    list.push_back(u);
+    ++count_;
+    return 1;
+}
+
+quint32 usagetable::lookup(const dictionary::word& word) const
+{
+    const auto it = table_.find(word.key);
+    if (it == std::end(table_))
+        return 0;
+
+    for (const auto& u : it->second)
+    {
+        if (u.traditional == word.traditional &&
+            u.simplified == word.simplified &&
+            u.pinyin == word.pinyin)
+            return u.count;
+    }
+    return 0;
+}
+
+} // pime
@@ -0,0 +1,76 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#include "warnpop.h"
+
+#include <map>
+#include <vector>
+#include "dictionary.h"
+
+namespace pime
+{
+    // keep track of how many times the user has selected each word
+    // for translating its key. the words are identified by their
+    // traditional, simplified and pinyin so the counts stay valid
+    // across dictionary reloads.
+    class usagetable
+    {
+    public:
+        usagetable();
+       ~usagetable();
+
+        void load(const QString& file);
+
+        void save(const QString& file) const;
+
+        // record a selection of the word and return the new count.
+        quint32 record(const dictionary::word& word);
+
+        // lookup the number of times the word has been selected.
+        quint32 lookup(const dictionary::word& word) const;
+
+        std::size_t usageCount() const
+        { return count_; }
+
+        // return the number of selections recorded since the table was created.
+        quint32 generation() const
+        { return generation_; }
+    private:
+        struct usage {
+            QString traditional;
+            QString simplified;
+            QString pinyin;
+            quint32 count;
+        };
+        // words with the same key are kept together, there's
+        // only a handful of them per key.
+        std::map<QString, std::vector<usage>> table_;
+        std::size_t count_;
+        quint32 generation_;
+    };
+
+} // pime
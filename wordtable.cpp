@@ -0,0 +1,255 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QFile>
+#  include <QIODevice>
+#include "warnpop.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "wordtable.h"
+#include "textfile.h"
+#include "format.h"
+#include "dicfile.h"
+
+// the word frequency data is a tab separated text file with
+// one word or word pair per line:
+// word<TAB>count
+// word<TAB>next word<TAB>count
+
+namespace pime
+{
+
+wordtable::wordtable() : checksum_(0)
+{
+    offsets_.push_back(0);
+    bigrams_.push_back(0);
+}
+
+wordtable::~wordtable()
+{}
+
+void wordtable::load(const QString& file)
+{
+    struct unigram {
+        QString word;
+        quint64 count;
+    };
+    struct bigram {
+        QString first;
+        QString second;
+        quint64 count;
+    };
+    std::vector<unigram> unigrams;
+    std::vector<bigram> bigrams;
+
+    textfile text(file);
+    while (text.next())
+    {
+        textfile::field toks[3];
+        bool ok = false;
+
+        const auto count = text.fields('\t');
+        if (count == 2)
+        {
+            text.split('\t', toks, 2);
+            unigram u;
+            u.word  = toks[0].toString();
+            u.count = toks[1].toLongLong(&ok);
+            unigrams.push_back(u);
+        }
+        else if (count == 3)
+        {
+            text.split('\t', toks, 3);
+            bigram b;
+            b.first  = toks[0].toString();
+            b.second = toks[1].toString();
+            b.count  = toks[2].toLongLong(&ok);
+            bigrams.push_back(b);
+            // make sure that both words have an id
+            unigrams.push_back(unigram{b.first, 0});
+            unigrams.push_back(unigram{b.second, 0});
+        }
+        if (!ok)
+            throw text.error("unexpected word frequency table data");
+    }
+
+    // merge with the current data. the words need to be copied
+    // out of the pool since the pool is about to be replaced.
+    const auto copy = [&](quint32 id) {
+        const auto& w = word(id);
+        return QString(w.unicode(), w.size());
+    };
+    for (std::size_t i=0; i<counts_.size(); ++i)
+        unigrams.push_back(unigram{copy(i), dequantize(counts_[i])});
+    for (std::size_t i=0; i<counts_.size(); ++i)
+    {
+        for (auto j=bigrams_[i]; j<bigrams_[i+1]; ++j)
+            bigrams.push_back(bigram{copy(i), copy(successors_[j]), dequantize(successorCounts_[j])});
+    }
+
+    std::sort(std::begin(unigrams), std::end(unigrams),
+        [](const unigram& lhs, const unigram& rhs) {
+            return lhs.word < rhs.word;
+        });
+
+    QString pool;
+    std::vector<quint32> offsets;
+    std::vector<quint64> counts;
+    offsets.push_back(0);
+    for (const auto& u : unigrams)
+    {
+        if (!counts.empty() && word(pool, offsets, counts.size()-1) == u.word)
+        {
+            counts.back() += u.count;
+            continue;
+        }
+        pool.append(u.word);
+        offsets.push_back(pool.size());
+        counts.push_back(u.count);
+    }
+
+    pool_    = pool;
+    offsets_ = std::move(offsets);
+    counts_.resize(counts.size());
+    for (std::size_t i=0; i<counts.size(); ++i)
+        counts_[i] = quantize(counts[i]);
+
+    struct successor {
+        quint32 first;
+        quint32 second;
+        quint64 count;
+    };
+    std::vector<successor> list;
+    for (const auto& b : bigrams)
+        list.push_back(successor{find(b.first), find(b.second), b.count});
+
+    std::sort(std::begin(list), std::end(list),
+        [](const successor& lhs, const successor& rhs) {
+            if (lhs.first != rhs.first)
+                return lhs.first < rhs.first;
+            return lhs.second < rhs.second;
+        });
+
+    // merge duplicate pairs and then order each word's
+    // successors by their frequency.
+    std::vector<successor> merged;
+    for (const auto& s : list)
+    {
+        if (!merged.empty() && merged.back().first == s.first && merged.back().second == s.second)
+            merged.back().count += s.count;
+        else merged.push_back(s);
+    }
+    std::stable_sort(std::begin(merged), std::end(merged),
+        [](const successor& lhs, const successor& rhs) {
+            if (lhs.first != rhs.first)
+                return lhs.first < rhs.first;
+            return lhs.count > rhs.count;
+        });
+
+    bigrams_.assign(counts_.size() + 1, 0);
+    successors_.resize(merged.size());
+    successorCounts_.resize(merged.size());
+    for (std::size_t i=0; i<merged.size(); ++i)
+    {
+        successors_[i]      = merged[i].second;
+        successorCounts_[i] = quantize(merged[i].count);
+        bigrams_[merged[i].first + 1]++;
+    }
+    for (std::size_t i=1; i<bigrams_.size(); ++i)
+        bigrams_[i] += bigrams_[i-1];
+
+    checksum_ = dicfile::checksum(text.data(), text.size(), checksum_);
+}
+
+quint32 wordtable::find(const QString& word) const
+{
+    // binary search over the sorted words in the pool
+    quint32 lo = 0;
+    quint32 hi = counts_.size();
+    while (lo < hi)
+    {
+        const auto mid = lo + (hi - lo) / 2;
+        const auto cmp = QString::compare(this->word(mid), word);
+        if (cmp == 0)
+            return mid;
+        else if (cmp < 0)
+            lo = mid + 1;
+        else hi = mid;
+    }
+    return NoWord;
+}
+
+QString wordtable::word(quint32 id) const
+{
+    return word(pool_, offsets_, id);
+}
+
+quint32 wordtable::unigram(const QString& word) const
+{
+    const auto id = find(word);
+    if (id == NoWord)
+        return 0;
+    return dequantize(counts_[id]);
+}
+
+quint32 wordtable::bigram(const QString& first, const QString& second) const
+{
+    const auto a = find(first);
+    if (a == NoWord)
+        return 0;
+    const auto b = find(second);
+    if (b == NoWord)
+        return 0;
+
+    for (auto i=bigrams_[a]; i<bigrams_[a+1]; ++i)
+    {
+        if (successors_[i] == b)
+            return dequantize(successorCounts_[i]);
+    }
+    return 0;
+}
+
+QString wordtable::word(const QString& pool, const std::vector<quint32>& offsets, quint32 id)
+{
+    const auto beg = offsets[id];
+    const auto end = offsets[id+1];
+    return QString::fromRawData(pool.unicode() + beg, end - beg);
+}
+
+// the counts are stored as 8 * log2(1 + count) which covers
+// counts up to 2^32 with a precision of about 9%.
+quint8 wordtable::quantize(quint64 count)
+{
+    const auto q = std::lround(8.0 * std::log2(1.0 + count));
+    return (quint8)std::min<long>(q, 255);
+}
+
+quint32 wordtable::dequantize(quint8 count)
+{
+    return (quint32)std::lround(std::exp2(count / 8.0) - 1.0);
+}
+
+} // pime
@@ -0,0 +1,104 @@
+// Copyright (c) 2010-2014 Sami Väisänen, Ensisoft 
+//
+// http://www.ensisoft.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#pragma once
+
+#include "config.h"
+#include "warnpush.h"
+#  include <QString>
+#include "warnpop.h"
+
+#include <vector>
+#include <utility>
+
+namespace pime
+{
+    // word (unigram) and word pair (bigram) frequencies.
+    // the words are kept sorted in a single string pool and
+    // identified by their index in the sorted order. the counts
+    // are quantized on a log scale into a single byte and the
+    // bigrams are stored as a list of successors per word.
+    // the table isn't changed after loading so the const members
+    // can be called from several threads.
+    class wordtable
+    {
+    public:
+        enum : quint32 { NoWord = 0xffffffff };
+
+        wordtable();
+       ~wordtable();
+
+        void load(const QString& file);
+
+        // find the id of the given word or NoWord if not found.
+        quint32 find(const QString& word) const;
+
+        // get the word with the given id.
+        QString word(quint32 id) const;
+
+        // lookup the (approximate) frequency of the word.
+        quint32 unigram(const QString& word) const;
+
+        // lookup the (approximate) frequency of the second
+        // word following the first word.
+        quint32 bigram(const QString& first, const QString& second) const;
+
+        // get the ids of the words that have been seen following the
+        // word with the given id. the most likely successor comes first.
+        std::pair<const quint32*, const quint32*> successors(quint32 id) const
+        {
+            if (id >= counts_.size() || bigrams_[id] == bigrams_[id+1])
+                return std::make_pair(nullptr, nullptr);
+            const auto* base = &successors_[0];
+            return std::make_pair(base + bigrams_[id], base + bigrams_[id+1]);
+        }
+
+        std::size_t wordCount() const
+        { return counts_.size(); }
+
+        std::size_t bigramCount() const
+        { return successors_.size(); }
+
+        // the checksum of the loaded files (see dicfile::checksum)
+        // or 0 if nothing has been loaded.
+        quint32 checksum() const
+        { return checksum_; }
+    private:
+        static QString word(const QString& pool, const std::vector<quint32>& offsets, quint32 id);
+        static quint8 quantize(quint64 count);
+        static quint32 dequantize(quint8 count);
+
+    private:
+        // all the words back to back in sorted order.
+        QString pool_;
+        // word i is in pool_[offsets_[i], offsets_[i+1])
+        std::vector<quint32> offsets_;
+        std::vector<quint8> counts_;
+        // the successors of word i are in 
+        // successors_[bigrams_[i], bigrams_[i+1]) sorted by frequency.
+        std::vector<quint32> bigrams_;
+        std::vector<quint32> successors_;
+        std::vector<quint8> successorCounts_;
+        quint32 checksum_;
+    };
+
+} // pime